@@ -0,0 +1,399 @@
+#pragma once
+/*
+ * An arena is a region allocator for scratch memory with a common
+ * lifetime, e.g., everything allocated while handling one request.
+ *
+ * Like a vec, an arena is a pointer to a byte array, with the capacity
+ * and size (the bump index) in a header right before the data.  The
+ * arena's state lives in a larger header, in front of that vec header.
+ * When the array is full, allocations continue in overflow chunks,
+ * chained after the first.
+ *
+ * Allocations are pointer bumps, and are never freed individually:
+ * `cls_arena_rewind` frees everything allocated since a mark, and
+ * `cls_arena_reset` everything, both in constant time.  Overflow
+ * chunks are kept for reuse until `cls_arena_destroy`.
+ *
+ * Vecs and bufs allocated in an arena are regular vecs and bufs,
+ * except that they must not be passed to `cls_vec_destroy`.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "classless.h"
+#include "classless_buf.h"
+#include "classless_vec.h"
+
+struct classless_arena_chunk {
+        struct classless_arena_chunk *next;
+        /* Keep the data 16-byte aligned, like malloc. */
+        size_t padding;
+        /* Capacity and size in bytes. */
+        struct classless_vec_header vec;
+};
+
+struct classless_arena_header {
+        /* The chunk we're bumping into. */
+        struct classless_arena_chunk *current;
+        size_t padding;
+        /* The first chunk, whose data follows the header. */
+        struct classless_arena_chunk first;
+};
+
+/*
+ * Identifies a point in the arena's allocation history.
+ */
+struct classless_arena_mark {
+        struct classless_arena_chunk *chunk;
+        size_t size;
+};
+
+/*
+ * The backing storage of a buf allocated in an arena.
+ */
+struct classless_arena_buf {
+        size_t size;
+        /* SIZE_PTR, CAPACITY, SIZE, DATA, NULL. */
+        void *slots[5];
+};
+
+/*
+ * The pointer to the data array is tagged with address space 110.
+ */
+CLS_TAG_REGISTER(classless_arena, 110);
+
+/*
+ * An arena is `uint8_t cls_arena *`.
+ */
+#define cls_arena CLS_TAG(classless_arena)
+
+/*
+ * Allocates an arena whose first chunk (and default overflow chunk
+ * size) is CAPACITY bytes, or returns NULL on allocation failure.
+ */
+#define cls_arena_create(CAPACITY)                                      \
+        ((uint8_t cls_arena *) classless_arena_create_((CAPACITY)))
+
+/*
+ * Deallocates an arena, with everything allocated in it.  Safe to call
+ * on NULL.
+ */
+#define cls_arena_destroy(ARENA)                                        \
+        ({                                                              \
+                CLS_LET(cls_arena_, (ARENA));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_arena, cls_arena_);     \
+                                                                        \
+                classless_arena_destroy_((cls_arena_ == NULL)           \
+                    ? NULL                                              \
+                    : CLS_HEADER_OF(classless_arena_header, cls_arena_)); \
+        })
+
+/*
+ * Attempts to reserve SIZE bytes aligned to ALIGN (a power of two) in
+ * the arena, moving to an overflow chunk if necessary.
+ *
+ * Returns a pointer to the reserved bytes, or NULL on allocation
+ * failure.
+ */
+#define cls_arena_reserve(ARENA, SIZE, ALIGN)                           \
+        ({                                                              \
+                CLS_LET(cls_arena_, (ARENA));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_arena, cls_arena_);     \
+                                                                        \
+                classless_arena_reserve_(                               \
+                        CLS_HEADER_OF(classless_arena_header, cls_arena_), \
+                        (SIZE), (ALIGN), 0);                            \
+        })
+
+/*
+ * Commits SIZE previously reserved bytes.
+ *
+ * Returns true on success, does nothing and returns false if that's
+ * more than what's left in the current chunk.
+ */
+#define cls_arena_commit(ARENA, SIZE)                                   \
+        ({                                                              \
+                CLS_LET(cls_arena_, (ARENA));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_arena, cls_arena_);     \
+                                                                        \
+                classless_arena_commit_(                                \
+                        CLS_HEADER_OF(classless_arena_header, cls_arena_), \
+                        (SIZE));                                        \
+        })
+
+/*
+ * Allocates an array of N uninitialized T in the arena.
+ *
+ * Returns a pointer to the array, or NULL on allocation failure.
+ */
+#define cls_arena_alloc(ARENA, T, N)                                    \
+        ({                                                              \
+                CLS_LET(cls_arena_, (ARENA));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_arena, cls_arena_);     \
+                                                                        \
+                (__typeof__(T) *)classless_arena_alloc_(                \
+                        CLS_HEADER_OF(classless_arena_header, cls_arena_), \
+                        (N), sizeof(T), _Alignof(__typeof__(T)));       \
+        })
+
+/*
+ * Allocates an empty vec of T with the specified capacity, header
+ * included, in the arena.
+ *
+ * Returns NULL on allocation failure.
+ */
+#define cls_arena_vec(ARENA, T, CAPACITY)                               \
+        ({                                                              \
+                CLS_LET(cls_arena_, (ARENA));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_arena, cls_arena_);     \
+                                                                        \
+                (__typeof__(T) cls_vec *)classless_arena_vec_(          \
+                        CLS_HEADER_OF(classless_arena_header, cls_arena_), \
+                        (CAPACITY), sizeof(T), _Alignof(__typeof__(T))); \
+        })
+
+/*
+ * Allocates an empty write buf of T with the specified capacity, and
+ * its backing storage, in the arena.
+ *
+ * Returns NULL on allocation failure.
+ */
+#define cls_arena_buf(ARENA, T, CAPACITY)                               \
+        ({                                                              \
+                CLS_LET(cls_arena_, (ARENA));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_arena, cls_arena_);     \
+                                                                        \
+                (__typeof__(T) cls_buf *)classless_arena_buf_(          \
+                        CLS_HEADER_OF(classless_arena_header, cls_arena_), \
+                        (CAPACITY), sizeof(T), _Alignof(__typeof__(T))); \
+        })
+
+/*
+ * Returns a `struct classless_arena_mark` for the arena's current
+ * allocation state.
+ */
+#define cls_arena_mark(ARENA)                                           \
+        ({                                                              \
+                CLS_LET(cls_arena_, (ARENA));                           \
+                CLS_TAG_CHECK(classless_arena, cls_arena_);             \
+                CLS_LET_HEADER(classless_arena_header, cls_arena_h_, cls_arena_); \
+                                                                        \
+                (struct classless_arena_mark) {                         \
+                        .chunk = cls_arena_h_->current,                 \
+                        .size = cls_arena_h_->current->vec.size,        \
+                };                                                      \
+        })
+
+/*
+ * Frees everything allocated in the arena since MARK was taken.
+ */
+#define cls_arena_rewind(ARENA, MARK)                                   \
+        ({                                                              \
+                CLS_LET(cls_arena_, (ARENA));                           \
+                struct classless_arena_mark cls_arena_mark_ = (MARK);   \
+                CLS_MUTABLE_TAG_CHECK(classless_arena, cls_arena_);     \
+                CLS_LET_HEADER(classless_arena_header, cls_arena_h_, cls_arena_); \
+                                                                        \
+                cls_arena_h_->current = cls_arena_mark_.chunk;          \
+                cls_arena_h_->current->vec.size = cls_arena_mark_.size; \
+                (void)0;                                                \
+        })
+
+/*
+ * Frees everything allocated in the arena.
+ */
+#define cls_arena_reset(ARENA)                                          \
+        ({                                                              \
+                CLS_LET(cls_arena_, (ARENA));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_arena, cls_arena_);     \
+                CLS_LET_HEADER(classless_arena_header, cls_arena_h_, cls_arena_); \
+                                                                        \
+                cls_arena_h_->current = &cls_arena_h_->first;           \
+                cls_arena_h_->first.vec.size = 0;                       \
+                (void)0;                                                \
+        })
+
+static inline void *
+classless_arena_create_(size_t capacity)
+{
+        struct classless_arena_header *h;
+
+        if (capacity > SIZE_MAX - sizeof(*h))
+                return NULL;
+
+        h = malloc(sizeof(*h) + capacity);
+        if (h == NULL)
+                return NULL;
+
+        h->current = &h->first;
+        h->first.next = NULL;
+        h->first.vec.capacity = capacity;
+        h->first.vec.size = 0;
+        return h + 1;
+}
+
+static inline void
+classless_arena_destroy_(struct classless_arena_header *h)
+{
+        struct classless_arena_chunk *chunk;
+
+        if (h == NULL)
+                return;
+
+        chunk = h->first.next;
+        while (chunk != NULL) {
+                struct classless_arena_chunk *next = chunk->next;
+
+                free(chunk);
+                chunk = next;
+        }
+
+        free(h);
+        return;
+}
+
+/*
+ * Returns the padding needed for `chunk`'s next allocation, if
+ * (OFFSET bytes after its start) aligned to `align`, and SIZE bytes
+ * long, fits in `chunk`, and SIZE_MAX otherwise.
+ */
+static inline size_t
+classless_arena_fit_(const struct classless_arena_chunk *chunk,
+    size_t size, size_t align, size_t offset)
+{
+        uintptr_t next = (uintptr_t)(chunk + 1) + chunk->vec.size + offset;
+        size_t pad = (align - (next & (align - 1))) & (align - 1);
+        size_t remaining = chunk->vec.capacity - chunk->vec.size;
+
+        return (pad <= remaining && size <= remaining - pad) ? pad : SIZE_MAX;
+}
+
+/*
+ * Makes sure the current chunk has room for SIZE bytes, whose OFFSET'th
+ * byte is aligned to ALIGN, and returns a pointer to the first.  The
+ * bytes are not committed, but the padding is.
+ */
+static inline void *
+classless_arena_reserve_(struct classless_arena_header *h,
+    size_t size, size_t align, size_t offset)
+{
+        struct classless_arena_chunk *chunk = h->current;
+        size_t pad;
+
+        if (align == 0 || (align & (align - 1)) != 0)
+                return NULL;
+
+        pad = classless_arena_fit_(chunk, size, align, offset);
+        if (pad == SIZE_MAX) {
+                /* Try the next retained chunk, or chain a new one. */
+                chunk = chunk->next;
+                if (chunk != NULL) {
+                        chunk->vec.size = 0;
+                        pad = classless_arena_fit_(chunk, size, align, offset);
+                }
+
+                if (pad == SIZE_MAX) {
+                        size_t capacity = h->first.vec.capacity;
+
+                        if (align > SIZE_MAX / 4
+                            || size > SIZE_MAX - sizeof(*chunk) - 2 * align)
+                                return NULL;
+                        if (capacity < size + align)
+                                capacity = size + align;
+
+                        chunk = malloc(sizeof(*chunk) + capacity);
+                        if (chunk == NULL)
+                                return NULL;
+
+                        chunk->next = h->current->next;
+                        chunk->vec.capacity = capacity;
+                        chunk->vec.size = 0;
+                        h->current->next = chunk;
+                        pad = classless_arena_fit_(chunk, size, align, offset);
+                }
+
+                h->current = chunk;
+        }
+
+        chunk->vec.size += pad;
+        return (char *)(chunk + 1) + chunk->vec.size;
+}
+
+static inline bool
+classless_arena_commit_(struct classless_arena_header *h, size_t size)
+{
+        struct classless_arena_chunk *chunk = h->current;
+
+        if (size > chunk->vec.capacity - chunk->vec.size)
+                return false;
+
+        chunk->vec.size += size;
+        return true;
+}
+
+static inline void *
+classless_arena_alloc_(struct classless_arena_header *h,
+    size_t n, size_t elsize, size_t align)
+{
+        void *ret;
+
+        if (elsize != 0 && n > SIZE_MAX / elsize)
+                return NULL;
+
+        ret = classless_arena_reserve_(h, n * elsize, align, 0);
+        if (ret != NULL)
+                classless_arena_commit_(h, n * elsize);
+        return ret;
+}
+
+static inline void *
+classless_arena_vec_(struct classless_arena_header *h,
+    size_t capacity, size_t elsize, size_t align)
+{
+        struct classless_vec_header *vec;
+        size_t size;
+
+        if (align < _Alignof(struct classless_vec_header))
+                align = _Alignof(struct classless_vec_header);
+        if (elsize != 0 && capacity > (SIZE_MAX - sizeof(*vec)) / elsize)
+                return NULL;
+
+        /* Align the data, right after the header. */
+        size = sizeof(*vec) + capacity * elsize;
+        vec = classless_arena_reserve_(h, size, align, sizeof(*vec));
+        if (vec == NULL)
+                return NULL;
+
+        classless_arena_commit_(h, size);
+        vec->capacity = capacity;
+        vec->size = 0;
+        return vec + 1;
+}
+
+static inline void *
+classless_arena_buf_(struct classless_arena_header *h,
+    size_t capacity, size_t elsize, size_t align)
+{
+        struct classless_arena_buf *buf;
+        void *data;
+
+        buf = classless_arena_alloc_(h, 1, sizeof(*buf), _Alignof(struct classless_arena_buf));
+        if (buf == NULL)
+                return NULL;
+
+        data = classless_arena_alloc_(h, capacity, elsize, align);
+        if (data == NULL)
+                return NULL;
+
+        buf->size = 0;
+        buf->slots[4 + CLS_BUF_IDX_SIZE_PTR] = &buf->size;
+        buf->slots[4 + CLS_BUF_IDX_CAPACITY] = (void *)(uintptr_t)capacity;
+        buf->slots[4 + CLS_BUF_IDX_SIZE] = (void *)(uintptr_t)0;
+        buf->slots[4 + CLS_BUF_IDX_DATA] = data;
+        buf->slots[4] = NULL;
+        return &buf->slots[4];
+}
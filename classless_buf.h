@@ -134,7 +134,7 @@ enum {
                         (void *)(uintptr_t)cls_buf_[CLS_BUF_IDX_SIZE_PTR]; \
                                                                         \
                 (cls_buf_size_ <= cls_buf_capacity_)                    \
-                        && (cls_buf_size_ptr_ +=                        \
+                        && (*cls_buf_size_ptr_ +=                       \
                             (cls_buf_size_ - cls_buf_curr_size_),       \
                             cls_buf_[CLS_BUF_IDX_SIZE] =                \
                             (void *)(uintptr_t)cls_buf_size_,           \
@@ -188,7 +188,7 @@ enum {
                         (void *)(uintptr_t)cls_buf_[CLS_BUF_IDX_SIZE_PTR]; \
                                                                         \
                 (cls_buf_size_ < cls_buf_cap_)                          \
-                        && (memcpy(&cls_buf_[CLS_BUF_IDX_SIZE][cls_buf_size_++], \
+                        && (memcpy(&cls_buf_[CLS_BUF_IDX_DATA][cls_buf_size_++], \
                                    &cls_buf_x_,                         \
                                    sizeof(cls_buf_x_)),                 \
                             (*cls_buf_size_ptr_)++,                     \
@@ -0,0 +1,456 @@
+#pragma once
+/*
+ * A deque is a fixed-capacity ring buffer: like a vec, it's a pointer
+ * to its data array, with the capacity and size in a header right
+ * before the data, along with the index of the first element.  Pushes
+ * and pops at either end are O(1), and a full deque can be grown into
+ * a larger allocation.
+ *
+ * The elements are contiguous, except when they wrap around the end of
+ * the array; a deque's contents are thus exposed as at most two views.
+ * `cls_deque_compact` re-linearizes the deque in place for consumers
+ * that need a single view.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "classless.h"
+#include "classless_buf.h"
+
+struct classless_deque_header {
+        size_t capacity;
+        size_t size;
+        /* Index of the first element. */
+        size_t head;
+        /* Keep the data 16-byte aligned, like malloc. */
+        size_t padding;
+};
+
+/*
+ * The pointer to the data array is tagged with address space 109.
+ */
+CLS_TAG_REGISTER(classless_deque, 109);
+
+/*
+ * A deque is `T cls_deque *`.
+ */
+#define cls_deque CLS_TAG(classless_deque)
+
+/*
+ * Allocates an empty deque of T with the specified capacity, or
+ * returns NULL on allocation failure.
+ */
+#define cls_deque_create(T, CAPACITY)                                   \
+        ((__typeof__(T) cls_deque *) classless_deque_create_((CAPACITY), sizeof(T)))
+
+/*
+ * Deallocates a deque.  Safe to call on NULL.
+ */
+#define cls_deque_destroy(DEQUE)                                        \
+        ({                                                              \
+                CLS_LET(cls_deque_, (DEQUE));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_deque, cls_deque_);     \
+                                                                        \
+                classless_deque_destroy_(CLS_TAG_STRIPPED(classless_deque, cls_deque_)); \
+        })
+
+/*
+ * Returns a deque with the same contents as `DEQUE`, and room for at
+ * least CAPACITY elements.  `DEQUE` is deallocated unless it already
+ * had enough capacity, in which case it's returned as is.
+ *
+ * Returns NULL on allocation failure, and then `DEQUE` is unchanged.
+ */
+#define cls_deque_grow(DEQUE, CAPACITY)                                 \
+        ({                                                              \
+                CLS_LET(cls_deque_, (DEQUE));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_deque, cls_deque_);     \
+                                                                        \
+                (__typeof__(cls_deque_))classless_deque_grow_(          \
+                        CLS_HEADER_OF(classless_deque_header, cls_deque_), \
+                        (CAPACITY), sizeof(*cls_deque_));               \
+        })
+
+#define cls_deque_size(DEQUE)                                           \
+        ({                                                              \
+                CLS_LET(cls_deque_, (DEQUE));                           \
+                CLS_TAG_CHECK(classless_deque, cls_deque_);             \
+                                                                        \
+                (cls_deque_ == NULL)                                    \
+                ? 0                                                     \
+                : CLS_HEADER_OF(classless_deque_header, cls_deque_)->size; \
+        })
+
+#define cls_deque_capacity(DEQUE)                                       \
+        ({                                                              \
+                CLS_LET(cls_deque_, (DEQUE));                           \
+                CLS_TAG_CHECK(classless_deque, cls_deque_);             \
+                                                                        \
+                (cls_deque_ == NULL)                                    \
+                ? 0                                                     \
+                : CLS_HEADER_OF(classless_deque_header, cls_deque_)->capacity; \
+        })
+
+/*
+ * Returns a reference to the i'th value in the deque, counting from
+ * the front.
+ *
+ * Performs bound checking when asserts are enabled.
+ */
+#define cls_deque_at(DEQUE, I) (*CLS_DEQUE_AT_((DEQUE), (I)))
+
+#define CLS_DEQUE_AT_(DEQUE, I)                                         \
+        ({                                                              \
+                CLS_LET(cls_deque_, DEQUE);                             \
+                size_t cls_deque_i_ = I;                                \
+                CLS_TAG_CHECK(classless_deque, cls_deque_);             \
+                CLS_LET_HEADER(classless_deque_header, cls_deque_h_, cls_deque_); \
+                                                                        \
+                assert(cls_deque_i_ < cls_deque_h_->size);              \
+                (cls_deque_i_ < cls_deque_h_->size)                     \
+                        ? &CLS_TAG_STRIPPED(classless_deque, cls_deque_)[ \
+                                classless_deque_index_(cls_deque_h_, cls_deque_i_)] \
+                        : NULL;                                         \
+        })
+
+/*
+ * Returns a pointer to the first element in the deque, or NULL if the
+ * deque is empty.
+ */
+#define cls_deque_front(DEQUE)                                          \
+        ({                                                              \
+                CLS_LET(cls_deque_, (DEQUE));                           \
+                CLS_TAG_CHECK(classless_deque, cls_deque_);             \
+                CLS_LET_HEADER(classless_deque_header, cls_deque_h_, cls_deque_); \
+                                                                        \
+                (cls_deque_h_->size > 0)                                \
+                        ? &CLS_TAG_STRIPPED(classless_deque, cls_deque_)[cls_deque_h_->head] \
+                        : NULL;                                         \
+        })
+
+/*
+ * Returns a pointer to the last element in the deque, or NULL if the
+ * deque is empty.
+ */
+#define cls_deque_back(DEQUE)                                           \
+        ({                                                              \
+                CLS_LET(cls_deque_, (DEQUE));                           \
+                CLS_TAG_CHECK(classless_deque, cls_deque_);             \
+                CLS_LET_HEADER(classless_deque_header, cls_deque_h_, cls_deque_); \
+                                                                        \
+                (cls_deque_h_->size > 0)                                \
+                        ? &CLS_TAG_STRIPPED(classless_deque, cls_deque_)[ \
+                                classless_deque_index_(cls_deque_h_,    \
+                                                       cls_deque_h_->size - 1)] \
+                        : NULL;                                         \
+        })
+
+/*
+ * Attempts to add `X` at the back of the deque.
+ *
+ * Returns true on success, false if the deque is at capacity.
+ */
+#define cls_deque_push_back(DEQUE, X)                                   \
+        ({                                                              \
+                CLS_LET(cls_deque_, (DEQUE));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_deque, cls_deque_);     \
+                __typeof__(*CLS_TAG_STRIPPED(classless_deque, cls_deque_)) \
+                        cls_deque_x_ = (X);                             \
+                CLS_LET_STRIPPED(classless_deque, cls_deque_ptr_, cls_deque_); \
+                CLS_LET_HEADER(classless_deque_header, cls_deque_h_, cls_deque_); \
+                                                                        \
+                (cls_deque_h_->size < cls_deque_h_->capacity)           \
+                        && (memcpy(&cls_deque_ptr_[classless_deque_index_( \
+                                           cls_deque_h_, cls_deque_h_->size)], \
+                                   &cls_deque_x_, sizeof(cls_deque_x_)), \
+                            cls_deque_h_->size++, true);                \
+        })
+
+/*
+ * Attempts to add `X` at the front of the deque.
+ *
+ * Returns true on success, false if the deque is at capacity.
+ */
+#define cls_deque_push_front(DEQUE, X)                                  \
+        ({                                                              \
+                CLS_LET(cls_deque_, (DEQUE));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_deque, cls_deque_);     \
+                __typeof__(*CLS_TAG_STRIPPED(classless_deque, cls_deque_)) \
+                        cls_deque_x_ = (X);                             \
+                CLS_LET_STRIPPED(classless_deque, cls_deque_ptr_, cls_deque_); \
+                CLS_LET_HEADER(classless_deque_header, cls_deque_h_, cls_deque_); \
+                                                                        \
+                (cls_deque_h_->size < cls_deque_h_->capacity)           \
+                        && (cls_deque_h_->head = (cls_deque_h_->head > 0) \
+                            ? cls_deque_h_->head - 1                    \
+                            : cls_deque_h_->capacity - 1,               \
+                            memcpy(&cls_deque_ptr_[cls_deque_h_->head], \
+                                   &cls_deque_x_, sizeof(cls_deque_x_)), \
+                            cls_deque_h_->size++, true);                \
+        })
+
+/*
+ * Attempts to remove the first element from the deque.
+ *
+ * Returns true on success, false if the deque is empty.
+ */
+#define cls_deque_pop_front(DEQUE)                                      \
+        ({                                                              \
+                CLS_LET(cls_deque_, (DEQUE));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_deque, cls_deque_);     \
+                                                                        \
+                classless_deque_pop_front_(                             \
+                        CLS_HEADER_OF(classless_deque_header, cls_deque_)); \
+        })
+
+/*
+ * Attempts to remove the last element from the deque.
+ *
+ * Returns true on success, false if the deque is empty.
+ */
+#define cls_deque_pop_back(DEQUE)                                       \
+        ({                                                              \
+                CLS_LET(cls_deque_, (DEQUE));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_deque, cls_deque_);     \
+                CLS_LET_HEADER(classless_deque_header, cls_deque_h_, cls_deque_); \
+                                                                        \
+                (cls_deque_h_->size > 0) && (cls_deque_h_->size--, true); \
+        })
+
+/*
+ * Converts a deque to a const view of its I'th contiguous segment,
+ * where I is 0 or 1: the elements from the front of the deque to the
+ * end of the array, then those that wrap around to the start of the
+ * array.  Either may be empty.
+ *
+ * Like `cls_buf_const_view`, the result must be used directly as a
+ * function argument; DEQUE and I are evaluated more than once.
+ */
+#define cls_deque_const_view(DEQUE, I)                                  \
+        cls_buf_const_view(                                             \
+                cls_buf_block(                                          \
+                        &CLS_TAG_STRIPPED(classless_deque, CLS_DEQUE_CHECKED_(DEQUE))[ \
+                                classless_deque_segment_(               \
+                                        CLS_HEADER_OF(classless_deque_header, (DEQUE)), \
+                                        (I), true)],                    \
+                        NULL,                                           \
+                        classless_deque_segment_(                       \
+                                CLS_HEADER_OF(classless_deque_header, (DEQUE)), \
+                                (I), false),                            \
+                        classless_deque_segment_(                       \
+                                CLS_HEADER_OF(classless_deque_header, (DEQUE)), \
+                                (I), false)))
+
+/*
+ * Evaluates to DEQUE if it's a deque, and fails to compile otherwise.
+ */
+#define CLS_DEQUE_CHECKED_(DEQUE)                                       \
+        __builtin_choose_expr(CLS_IS_TAG(classless_deque, (DEQUE)), (DEQUE), (void)0)
+
+/*
+ * Rotates the deque's elements in place so that they're contiguous
+ * and start at the beginning of the array: afterwards, the whole
+ * contents are in the first const view.  Takes linear time and no
+ * extra memory.
+ *
+ * Returns a pointer to the first element.
+ */
+#define cls_deque_compact(DEQUE)                                        \
+        ({                                                              \
+                CLS_LET(cls_deque_, (DEQUE));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_deque, cls_deque_);     \
+                CLS_LET_STRIPPED(classless_deque, cls_deque_ptr_, cls_deque_); \
+                                                                        \
+                classless_deque_compact_(                               \
+                        CLS_HEADER_OF(classless_deque_header, cls_deque_), \
+                        sizeof(*cls_deque_ptr_));                       \
+                cls_deque_ptr_;                                         \
+        })
+
+static inline struct classless_deque_header *
+classless_deque_alloc_(size_t capacity, size_t elsize)
+{
+        struct classless_deque_header *h;
+
+        if (elsize != 0 && capacity > (SIZE_MAX - sizeof(*h)) / elsize)
+                return NULL;
+
+        h = malloc(sizeof(*h) + capacity * elsize);
+        if (h == NULL)
+                return NULL;
+
+        h->capacity = capacity;
+        h->size = 0;
+        h->head = 0;
+        return h;
+}
+
+static inline void *
+classless_deque_create_(size_t capacity, size_t elsize)
+{
+        struct classless_deque_header *h = classless_deque_alloc_(capacity, elsize);
+
+        return h == NULL ? NULL : h + 1;
+}
+
+static inline void
+classless_deque_destroy_(void *data)
+{
+        struct classless_deque_header *h;
+
+        if (data == NULL)
+                return;
+
+        h = (struct classless_deque_header *)data - 1;
+        free(h);
+        return;
+}
+
+/*
+ * Maps the i'th element from the front to its index in the array.
+ */
+static inline size_t
+classless_deque_index_(const struct classless_deque_header *h, size_t i)
+{
+
+        return (i < h->capacity - h->head) ? h->head + i : i - (h->capacity - h->head);
+}
+
+/*
+ * Returns the first index (if `begin`) or the size of the I'th
+ * contiguous segment.
+ */
+static inline size_t
+classless_deque_segment_(const struct classless_deque_header *h, size_t i, bool begin)
+{
+        size_t first = h->capacity - h->head;
+
+        if (first > h->size)
+                first = h->size;
+
+        if (i == 0)
+                return begin ? h->head : first;
+
+        return begin ? 0 : h->size - first;
+}
+
+static inline bool
+classless_deque_pop_front_(struct classless_deque_header *h)
+{
+
+        if (h->size == 0)
+                return false;
+
+        h->size--;
+        h->head = (h->head + 1 < h->capacity) ? h->head + 1 : 0;
+        return true;
+}
+
+/*
+ * Exchanges the n bytes at `x` and `y`, which must not overlap.
+ */
+static inline void
+classless_deque_swap_(char *x, char *y, size_t n)
+{
+        char tmp[256];
+
+        while (n > 0) {
+                size_t chunk = (n < sizeof(tmp)) ? n : sizeof(tmp);
+
+                memcpy(tmp, x, chunk);
+                memcpy(x, y, chunk);
+                memcpy(y, tmp, chunk);
+                x += chunk;
+                y += chunk;
+                n -= chunk;
+        }
+
+        return;
+}
+
+/*
+ * Turns the `left` bytes at `p` followed by `right` bytes into the
+ * `right` bytes followed by the `left` bytes, with block swaps.
+ */
+static inline void
+classless_deque_rotate_(char *p, size_t left, size_t right)
+{
+
+        while (left > 0 && right > 0) {
+                if (left <= right) {
+                        /* [L][R1][R2] -> [R1][L][R2], with |R1| = |L|. */
+                        classless_deque_swap_(p, p + left, left);
+                        p += left;
+                        right -= left;
+                } else {
+                        /* [L1][L2][R] -> [L1][R][L2], with |L2| = |R|. */
+                        classless_deque_swap_(p + left - right, p + left, right);
+                        left -= right;
+                }
+        }
+
+        return;
+}
+
+static inline void
+classless_deque_compact_(struct classless_deque_header *h, size_t elsize)
+{
+        char *bytes = (char *)(h + 1);
+        size_t first = h->capacity - h->head;
+        size_t second;
+
+        if (h->head == 0)
+                return;
+
+        if (h->size <= first) {
+                memmove(bytes, bytes + h->head * elsize, h->size * elsize);
+                h->head = 0;
+                return;
+        }
+
+        /*
+         * The deque wraps around: the front segment is at the end of
+         * the array, and the rest at the start.
+         */
+        second = h->size - first;
+        if (first <= h->head - second) {
+                /* The front segment fits in the gap: shift the rest right. */
+                memmove(bytes + first * elsize, bytes, second * elsize);
+                memcpy(bytes, bytes + h->head * elsize, first * elsize);
+        } else {
+                /* Close the gap, then swap the two segments. */
+                memmove(bytes + second * elsize, bytes + h->head * elsize,
+                    first * elsize);
+                classless_deque_rotate_(bytes, second * elsize, first * elsize);
+        }
+
+        h->head = 0;
+        return;
+}
+
+static inline void *
+classless_deque_grow_(struct classless_deque_header *h, size_t capacity, size_t elsize)
+{
+        struct classless_deque_header *grown;
+        const char *data = (const char *)(h + 1);
+        size_t first;
+
+        if (capacity <= h->capacity)
+                return h + 1;
+
+        grown = classless_deque_alloc_(capacity, elsize);
+        if (grown == NULL)
+                return NULL;
+
+        first = classless_deque_segment_(h, 0, false);
+        memcpy(grown + 1, data + h->head * elsize, first * elsize);
+        memcpy((char *)(grown + 1) + first * elsize, data, (h->size - first) * elsize);
+        grown->size = h->size;
+        free(h);
+        return grown + 1;
+}
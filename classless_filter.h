@@ -0,0 +1,290 @@
+#pragma once
+/*
+ * Stream compaction: copying or keeping only the elements that satisfy
+ * a predicate.
+ *
+ * Branches on the predicate mispredict about half the time at 50%
+ * selectivity, so all the loops here are branch-free: they always
+ * store the current element at the output cursor, and only advance
+ * the cursor when the element is selected.  The buf versions never
+ * store past the destination's capacity: the element-at-a-time loops
+ * stop when the cursor reaches it, and the chunked loops only run
+ * while a whole chunk would fit even if every element were selected.
+ *
+ * Selections of 4-byte elements are further sped up with AVX-512F
+ * compress stores when available, or with AVX2 and BMI2 lane
+ * permutations (16 and 8 elements per iteration, respectively).
+ *
+ * PRED is a function or function-like macro such that `PRED(X)` is
+ * true when the element value X is selected.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__BMI2__))
+# include <immintrin.h>
+#endif
+
+#include "classless.h"
+#include "classless_buf.h"
+#include "classless_vec.h"
+
+typedef uint32_t classless_filter_u32_t __attribute__((__may_alias__));
+
+/*
+ * Appends the elements of the view `SRC` that satisfy `PRED` to the
+ * mutable buf `DST`, until `SRC` is exhausted, or `DST` is full.
+ *
+ * Returns the number of elements consumed from `SRC`.
+ */
+#define cls_buf_filter(DST, SRC, PRED)                                  \
+        ({                                                              \
+                CLS_LET(cls_filter_dst_, (DST));                        \
+                CLS_LET(cls_filter_src_, (SRC));                        \
+                CLS_MUTABLE_TAG_CHECK(classless_buf, cls_filter_dst_);  \
+                CLS_TAG_CHECK(classless_buf, cls_filter_src_);          \
+                const __typeof__(**cls_filter_dst_) *cls_filter_in_ =   \
+                        cls_buf_data(cls_filter_src_);                  \
+                __typeof__(**cls_filter_dst_) *cls_filter_out_ =        \
+                        cls_buf_reserve(cls_filter_dst_, 0);            \
+                size_t cls_filter_room_ = cls_buf_capacity(cls_filter_dst_) \
+                        - cls_buf_size(cls_filter_dst_);                \
+                size_t cls_filter_n_ = cls_buf_size(cls_filter_src_);   \
+                size_t cls_filter_i_ = 0;                               \
+                size_t cls_filter_written_ = 0;                         \
+                                                                        \
+                /* Select in chunks of 64, one mask word at a time. */  \
+                while (cls_filter_n_ - cls_filter_i_ >= 64              \
+                       && cls_filter_room_ - cls_filter_written_ >= 64) { \
+                        uint64_t cls_filter_mask_ = 0;                  \
+                                                                        \
+                        for (size_t cls_filter_j_ = 0; cls_filter_j_ < 64; \
+                             cls_filter_j_++)                           \
+                                cls_filter_mask_ |= (uint64_t)!!PRED(   \
+                                        cls_filter_in_[cls_filter_i_ + cls_filter_j_]) \
+                                        << cls_filter_j_;               \
+                                                                        \
+                        cls_filter_written_ += CLS_FILTER_COMPRESS_(    \
+                                &cls_filter_out_[cls_filter_written_],  \
+                                &cls_filter_in_[cls_filter_i_],         \
+                                64, &cls_filter_mask_);                 \
+                        cls_filter_i_ += 64;                            \
+                }                                                       \
+                                                                        \
+                for (; cls_filter_i_ < cls_filter_n_                    \
+                             && cls_filter_written_ < cls_filter_room_; \
+                     cls_filter_i_++) {                                 \
+                        cls_filter_out_[cls_filter_written_] =          \
+                                cls_filter_in_[cls_filter_i_];          \
+                        cls_filter_written_ +=                          \
+                                !!PRED(cls_filter_in_[cls_filter_i_]);  \
+                }                                                       \
+                                                                        \
+                cls_buf_commit(cls_filter_dst_, cls_filter_written_);   \
+                cls_filter_i_;                                          \
+        })
+
+/*
+ * Appends the elements `SRC[i]` of the view `SRC` such that bit `i %
+ * 64` of `MASK[i / 64]` is set to the mutable buf `DST`, until `SRC`
+ * or `MASK` (a view of uint64_t) is exhausted, or `DST` is full.
+ *
+ * Returns the number of elements consumed from `SRC`.
+ */
+#define cls_buf_compress(DST, SRC, MASK)                                \
+        ({                                                              \
+                CLS_LET(cls_filter_dst_, (DST));                        \
+                CLS_LET(cls_filter_src_, (SRC));                        \
+                CLS_LET(cls_filter_mask_, (MASK));                      \
+                CLS_MUTABLE_TAG_CHECK(classless_buf, cls_filter_dst_);  \
+                CLS_TAG_CHECK(classless_buf, cls_filter_src_);          \
+                CLS_TAG_CHECK(classless_buf, cls_filter_mask_);         \
+                const __typeof__(**cls_filter_dst_) *cls_filter_in_ =   \
+                        cls_buf_data(cls_filter_src_);                  \
+                const uint64_t *cls_filter_bits_ = cls_buf_data(cls_filter_mask_); \
+                __typeof__(**cls_filter_dst_) *cls_filter_out_ =        \
+                        cls_buf_reserve(cls_filter_dst_, 0);            \
+                size_t cls_filter_room_ = cls_buf_capacity(cls_filter_dst_) \
+                        - cls_buf_size(cls_filter_dst_);                \
+                size_t cls_filter_n_ = cls_buf_size(cls_filter_src_);   \
+                size_t cls_filter_i_ = 0;                               \
+                size_t cls_filter_written_ = 0;                         \
+                                                                        \
+                if (cls_filter_n_ / 64 >= cls_buf_size(cls_filter_mask_)) \
+                        cls_filter_n_ = 64 * cls_buf_size(cls_filter_mask_); \
+                                                                        \
+                /* Whole mask words, as many as the worst case fits. */ \
+                while (cls_filter_n_ - cls_filter_i_ >= 64              \
+                       && cls_filter_room_ - cls_filter_written_ >= 64) { \
+                        size_t cls_filter_chunk_ = cls_filter_n_ - cls_filter_i_; \
+                                                                        \
+                        if (cls_filter_chunk_ > cls_filter_room_ - cls_filter_written_) \
+                                cls_filter_chunk_ = cls_filter_room_ - cls_filter_written_; \
+                        cls_filter_chunk_ &= -(size_t)64;               \
+                        cls_filter_written_ += CLS_FILTER_COMPRESS_(    \
+                                &cls_filter_out_[cls_filter_written_],  \
+                                &cls_filter_in_[cls_filter_i_],         \
+                                cls_filter_chunk_,                      \
+                                &cls_filter_bits_[cls_filter_i_ / 64]); \
+                        cls_filter_i_ += cls_filter_chunk_;             \
+                }                                                       \
+                                                                        \
+                for (; cls_filter_i_ < cls_filter_n_                    \
+                             && cls_filter_written_ < cls_filter_room_; \
+                     cls_filter_i_++) {                                 \
+                        cls_filter_out_[cls_filter_written_] =          \
+                                cls_filter_in_[cls_filter_i_];          \
+                        cls_filter_written_ +=                          \
+                                (cls_filter_bits_[cls_filter_i_ / 64]   \
+                                 >> (cls_filter_i_ % 64)) & 1;          \
+                }                                                       \
+                                                                        \
+                cls_buf_commit(cls_filter_dst_, cls_filter_written_);   \
+                cls_filter_i_;                                          \
+        })
+
+/*
+ * Removes all the elements of `VEC` that satisfy `PRED`, preserving
+ * the order of the remaining elements.  The vec's size is only
+ * updated once, at the end.
+ *
+ * Returns the number of elements removed.
+ */
+#define cls_vec_remove_if(VEC, PRED)                                    \
+        ({                                                              \
+                CLS_LET(cls_filter_vec_, (VEC));                        \
+                CLS_VEC_MUTABLE_TAG_CHECK_(cls_filter_vec_);            \
+                CLS_VEC_LET_STRIPPED_(cls_filter_ptr_, cls_filter_vec_); \
+                CLS_LET_HEADER(classless_vec_header, cls_filter_h_, cls_filter_vec_); \
+                size_t cls_filter_n_ = cls_filter_h_->size;             \
+                size_t cls_filter_kept_ = 0;                            \
+                                                                        \
+                for (size_t cls_filter_i_ = 0; cls_filter_i_ < cls_filter_n_; \
+                     cls_filter_i_++) {                                 \
+                        __typeof__(*cls_filter_ptr_) cls_filter_x_ =    \
+                                cls_filter_ptr_[cls_filter_i_];         \
+                                                                        \
+                        cls_filter_ptr_[cls_filter_kept_] = cls_filter_x_; \
+                        cls_filter_kept_ += !PRED(cls_filter_x_);       \
+                }                                                       \
+                                                                        \
+                cls_filter_h_->size = cls_filter_kept_;                 \
+                cls_filter_n_ - cls_filter_kept_;                       \
+        })
+
+/*
+ * Reorders the elements of `VEC` so that all the elements that
+ * satisfy `PRED` come before those that don't.  The partition is not
+ * stable.
+ *
+ * Returns the number of elements that satisfy `PRED`, i.e., the index
+ * of the first element that doesn't.
+ */
+#define cls_vec_partition(VEC, PRED)                                    \
+        ({                                                              \
+                CLS_LET(cls_filter_vec_, (VEC));                        \
+                CLS_VEC_MUTABLE_TAG_CHECK_(cls_filter_vec_);            \
+                CLS_VEC_LET_STRIPPED_(cls_filter_ptr_, cls_filter_vec_); \
+                CLS_LET_HEADER(classless_vec_header, cls_filter_h_, cls_filter_vec_); \
+                size_t cls_filter_n_ = cls_filter_h_->size;             \
+                size_t cls_filter_split_ = 0;                           \
+                                                                        \
+                /*                                                      \
+                 * [0, split) satisfy PRED, [split, i) don't: always    \
+                 * swap i with split, and only advance split when i     \
+                 * satisfies PRED.                                      \
+                 */                                                     \
+                for (size_t cls_filter_i_ = 0; cls_filter_i_ < cls_filter_n_; \
+                     cls_filter_i_++) {                                 \
+                        __typeof__(*cls_filter_ptr_) cls_filter_x_ =    \
+                                cls_filter_ptr_[cls_filter_i_];         \
+                        bool cls_filter_keep_ = PRED(cls_filter_x_);    \
+                                                                        \
+                        cls_filter_ptr_[cls_filter_i_] =                \
+                                cls_filter_ptr_[cls_filter_split_];     \
+                        cls_filter_ptr_[cls_filter_split_] = cls_filter_x_; \
+                        cls_filter_split_ += cls_filter_keep_;          \
+                }                                                       \
+                                                                        \
+                cls_filter_split_;                                      \
+        })
+
+/*
+ * Copies the elements IN[i] for i < N (a multiple of 64) such that
+ * bit i % 64 of MASK[i / 64] is set to OUT, which must have room for
+ * N elements.
+ *
+ * Returns the number of elements written.
+ */
+#define CLS_FILTER_COMPRESS_(OUT, IN, N, MASK)                          \
+        ({                                                              \
+                CLS_LET(cls_filter_c_out_, (OUT));                      \
+                CLS_LET(cls_filter_c_in_, (IN));                        \
+                size_t cls_filter_c_n_ = (N);                           \
+                const uint64_t *cls_filter_c_mask_ = (MASK);            \
+                size_t cls_filter_c_i_ = 0;                             \
+                size_t cls_filter_c_written_ = 0;                       \
+                                                                        \
+                if (sizeof(*cls_filter_c_out_) == sizeof(uint32_t))     \
+                        cls_filter_c_written_ = classless_filter_compress_u32_( \
+                                (void *)cls_filter_c_out_,              \
+                                (const void *)cls_filter_c_in_,         \
+                                cls_filter_c_n_, cls_filter_c_mask_);   \
+                else                                                    \
+                for (; cls_filter_c_i_ < cls_filter_c_n_; cls_filter_c_i_++) { \
+                        cls_filter_c_out_[cls_filter_c_written_] =      \
+                                cls_filter_c_in_[cls_filter_c_i_];      \
+                        cls_filter_c_written_ +=                        \
+                                (cls_filter_c_mask_[cls_filter_c_i_ / 64] \
+                                 >> (cls_filter_c_i_ % 64)) & 1;        \
+                }                                                       \
+                                                                        \
+                cls_filter_c_written_;                                  \
+        })
+
+/*
+ * CLS_FILTER_COMPRESS_ for 4-byte elements, with SIMD when available.
+ * N is a multiple of 64, so the SIMD loops never leave a tail.
+ */
+static inline size_t
+classless_filter_compress_u32_(classless_filter_u32_t *out, const classless_filter_u32_t *in,
+    size_t n, const uint64_t *mask)
+{
+        size_t written = 0;
+
+#if defined(__AVX512F__)
+        for (size_t i = 0; i < n; i += 16) {
+                __mmask16 bits = mask[i / 64] >> (i % 64);
+                __m512i v = _mm512_loadu_si512((const void *)&in[i]);
+
+                _mm512_mask_compressstoreu_epi32((void *)&out[written], bits, v);
+                written += __builtin_popcount(bits);
+        }
+#elif defined(__AVX2__) && defined(__BMI2__)
+        /*
+         * Expand the 8 mask bits to bytes, use them to extract the
+         * selected lane indices, and permute the selected lanes to
+         * the bottom of the vector.
+         */
+        for (size_t i = 0; i < n; i += 8) {
+                unsigned int bits = (mask[i / 64] >> (i % 64)) & 0xff;
+                uint64_t expanded = _pdep_u64(bits, UINT64_C(0x0101010101010101)) * 0xff;
+                uint64_t lanes = _pext_u64(UINT64_C(0x0706050403020100), expanded);
+                __m256i perm = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(lanes));
+                __m256i v = _mm256_loadu_si256((const void *)&in[i]);
+
+                _mm256_storeu_si256((void *)&out[written],
+                    _mm256_permutevar8x32_epi32(v, perm));
+                written += __builtin_popcount(bits);
+        }
+#else
+        for (size_t i = 0; i < n; i++) {
+                out[written] = in[i];
+                written += (mask[i / 64] >> (i % 64)) & 1;
+        }
+#endif
+
+        return written;
+}
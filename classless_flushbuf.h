@@ -0,0 +1,487 @@
+#pragma once
+/*
+ * A flushbuf is a write buffer with an attached sink: instead of
+ * failing when the buffer is full, pushes and reservations first
+ * flush the accumulated batch to the sink, and reset the write index.
+ * The capacity is thus the batch size.
+ *
+ * Internally, a flushbuf is a heap-allocated buf: the same array of
+ * pointers (and the same size bookkeeping) lives in the flushbuf's
+ * header, so `cls_flushbuf_buf` converts a flushbuf to a regular
+ * `T cls_buf *` for bulk writes (e.g., `cls_buf_gather`), without any
+ * copy.  Remember that bufs don't flush: they only see the room left
+ * in the current batch.
+ *
+ * Asynchronous flushbufs double-buffer: one half fills while a
+ * background thread drains the other half to the sink.  A flush only
+ * waits when the previous batch is still draining.  This requires
+ * pthreads.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "classless.h"
+#include "classless_buf.h"
+#include "classless_vec.h"
+
+/*
+ * Sinks consume `n` elements of `elsize` bytes at `data`, and return
+ * false on failure.  `data` is only valid for the duration of the
+ * call.  An asynchronous flushbuf calls its sink from the background
+ * thread.
+ */
+typedef bool classless_flushbuf_sink_fn(void *ctx, const void *data, size_t n, size_t elsize);
+
+struct classless_flushbuf_header {
+        classless_flushbuf_sink_fn *sink;
+        void *ctx;
+        size_t elsize;
+        /* The real size of the batch, updated through `slots`. */
+        size_t size;
+        /* Sticky: a flush failed. */
+        bool failed;
+
+        /* Double-buffering state, only used by async flushbufs. */
+        bool async;
+        bool stop;
+        bool pending;
+        void *spare;
+        const void *pending_data;
+        size_t pending_n;
+        pthread_t thread;
+        pthread_mutex_t lock;
+        /* Signaled when a batch is pending, or when stopping. */
+        pthread_cond_t ready;
+        /* Signaled when the pending batch has been drained. */
+        pthread_cond_t drained;
+
+        /*
+         * SIZE_PTR, CAPACITY, SIZE, DATA, as in a buf; the NULL slot
+         * immediately follows the header.
+         */
+        void *slots[4];
+};
+
+/*
+ * The handle, a pointer to the NULL slot, is tagged with address
+ * space 108.
+ */
+CLS_TAG_REGISTER(classless_flushbuf, 108);
+
+/*
+ * A flushbuf of T is `T cls_flushbuf *`.
+ */
+#define cls_flushbuf * CLS_TAG(classless_flushbuf)
+
+/*
+ * Allocates a flushbuf of T that flushes batches of CAPACITY elements
+ * with `SINK(CTX, data, n, sizeof(T))`, or returns NULL on failure.
+ * If ASYNC is true, the flushbuf double-buffers and drains batches on
+ * a background thread.
+ */
+#define cls_flushbuf_create(T, CAPACITY, SINK, CTX, ASYNC)              \
+        ((__typeof__(T) cls_flushbuf *)classless_flushbuf_create_(      \
+                (CAPACITY), sizeof(T), (SINK), (CTX), (ASYNC)))
+
+/*
+ * Allocates a flushbuf of T that writes its batches to the file
+ * descriptor FD, as raw bytes.
+ */
+#define cls_flushbuf_create_fd(T, CAPACITY, FD, ASYNC)                  \
+        cls_flushbuf_create(T, (CAPACITY), classless_flushbuf_fd_sink_, \
+                            (void *)(intptr_t)(FD), (ASYNC))
+
+/*
+ * Allocates a flushbuf that appends its batches to the mutable vec
+ * VEC (of the same type); flushes fail once VEC is full.  VEC must
+ * outlive the flushbuf.
+ */
+#define cls_flushbuf_create_vec(CAPACITY, VEC, ASYNC)                   \
+        ({                                                              \
+                CLS_LET(cls_flushbuf_vec_, (VEC));                      \
+                CLS_VEC_MUTABLE_TAG_CHECK_(cls_flushbuf_vec_);          \
+                CLS_VEC_LET_STRIPPED_(cls_flushbuf_data_, cls_flushbuf_vec_); \
+                                                                        \
+                (__typeof__(*cls_flushbuf_data_) cls_flushbuf *)        \
+                        classless_flushbuf_create_(                     \
+                                (CAPACITY), sizeof(*cls_flushbuf_data_), \
+                                classless_flushbuf_vec_sink_,           \
+                                (void *)cls_flushbuf_data_, (ASYNC));   \
+        })
+
+/*
+ * Flushes any pending data, and deallocates the flushbuf.  Safe to
+ * call on NULL.
+ *
+ * Returns false if any flush failed.
+ */
+#define cls_flushbuf_destroy(FB)                                        \
+        ({                                                              \
+                CLS_LET(cls_flushbuf_, (FB));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_flushbuf, cls_flushbuf_); \
+                                                                        \
+                classless_flushbuf_destroy_((cls_flushbuf_ == NULL)     \
+                    ? NULL                                              \
+                    : CLS_HEADER_OF(classless_flushbuf_header, cls_flushbuf_)); \
+        })
+
+/*
+ * Converts a flushbuf to a buf of the current batch.
+ */
+#define cls_flushbuf_buf(FB)                                            \
+        ({                                                              \
+                CLS_LET(cls_flushbuf_, (FB));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_flushbuf, cls_flushbuf_); \
+                                                                        \
+                (__typeof__(**cls_flushbuf_) cls_buf *)(uintptr_t)cls_flushbuf_; \
+        })
+
+/*
+ * Returns the number of elements in the current batch.
+ */
+#define cls_flushbuf_size(FB)                                           \
+        ({                                                              \
+                CLS_LET(cls_flushbuf_, (FB));                           \
+                CLS_TAG_CHECK(classless_flushbuf, cls_flushbuf_);       \
+                CLS_LET_HEADER(classless_flushbuf_header, cls_flushbuf_h_, \
+                    cls_flushbuf_);                                     \
+                                                                        \
+                cls_flushbuf_h_->size;                                  \
+        })
+
+/*
+ * Adds `X` at the end of the current batch, after flushing the batch
+ * if it's full.
+ *
+ * Returns true on success, false if the flush failed.
+ */
+#define cls_flushbuf_push(FB, X)                                        \
+        ({                                                              \
+                CLS_LET(cls_flushbuf_, (FB));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_flushbuf, cls_flushbuf_); \
+                CLS_LET_HEADER(classless_flushbuf_header, cls_flushbuf_h_, \
+                    cls_flushbuf_);                                     \
+                __typeof__(**cls_flushbuf_) cls_flushbuf_x_ = (X);      \
+                __typeof__(**cls_flushbuf_) *cls_flushbuf_dst_ =        \
+                        classless_flushbuf_reserve_(cls_flushbuf_h_, 1); \
+                                                                        \
+                (cls_flushbuf_dst_ != NULL)                             \
+                        && (memcpy(cls_flushbuf_dst_, &cls_flushbuf_x_, \
+                                   sizeof(cls_flushbuf_x_)),            \
+                            classless_flushbuf_commit_(cls_flushbuf_h_, 1)); \
+        })
+
+/*
+ * Reserves N elements in the current batch, after flushing the batch
+ * if it doesn't have room for N more elements.
+ *
+ * Returns a pointer to the reserved elements, or NULL if N exceeds
+ * the capacity, or the flush failed.
+ */
+#define cls_flushbuf_reserve(FB, N)                                     \
+        ({                                                              \
+                CLS_LET(cls_flushbuf_, (FB));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_flushbuf, cls_flushbuf_); \
+                CLS_LET_HEADER(classless_flushbuf_header, cls_flushbuf_h_, \
+                    cls_flushbuf_);                                     \
+                                                                        \
+                (__typeof__(**cls_flushbuf_) *)classless_flushbuf_reserve_( \
+                        cls_flushbuf_h_, (N));                          \
+        })
+
+/*
+ * Commits N previously reserved elements.
+ *
+ * Returns true on success, false if there wasn't room for N elements.
+ */
+#define cls_flushbuf_commit(FB, N)                                      \
+        ({                                                              \
+                CLS_LET(cls_flushbuf_, (FB));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_flushbuf, cls_flushbuf_); \
+                CLS_LET_HEADER(classless_flushbuf_header, cls_flushbuf_h_, \
+                    cls_flushbuf_);                                     \
+                                                                        \
+                classless_flushbuf_commit_(cls_flushbuf_h_, (N));       \
+        })
+
+/*
+ * Hands the current batch (if any) to the sink, and starts a new
+ * batch.  Asynchronous flushbufs only wait for the previous batch to
+ * drain.
+ *
+ * Returns false if this or any earlier flush failed; failures are
+ * sticky.
+ */
+#define cls_flushbuf_flush(FB)                                          \
+        ({                                                              \
+                CLS_LET(cls_flushbuf_, (FB));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_flushbuf, cls_flushbuf_); \
+                CLS_LET_HEADER(classless_flushbuf_header, cls_flushbuf_h_, \
+                    cls_flushbuf_);                                     \
+                                                                        \
+                classless_flushbuf_flush_(cls_flushbuf_h_);             \
+        })
+
+/*
+ * Flushes the current batch, and waits until the sink has consumed
+ * all batches.
+ *
+ * Returns false if any flush failed.
+ */
+#define cls_flushbuf_drain(FB)                                          \
+        ({                                                              \
+                CLS_LET(cls_flushbuf_, (FB));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_flushbuf, cls_flushbuf_); \
+                CLS_LET_HEADER(classless_flushbuf_header, cls_flushbuf_h_, \
+                    cls_flushbuf_);                                     \
+                                                                        \
+                classless_flushbuf_drain_(cls_flushbuf_h_);             \
+        })
+
+static inline void *
+classless_flushbuf_thread_(void *arg)
+{
+        struct classless_flushbuf_header *h = arg;
+
+        pthread_mutex_lock(&h->lock);
+        for (;;) {
+                const void *data;
+                size_t n;
+                bool ok;
+
+                while (!h->pending && !h->stop)
+                        pthread_cond_wait(&h->ready, &h->lock);
+
+                if (!h->pending)
+                        break;
+
+                data = h->pending_data;
+                n = h->pending_n;
+                pthread_mutex_unlock(&h->lock);
+
+                ok = h->sink(h->ctx, data, n, h->elsize);
+
+                pthread_mutex_lock(&h->lock);
+                h->failed |= !ok;
+                h->pending = false;
+                pthread_cond_broadcast(&h->drained);
+        }
+
+        pthread_mutex_unlock(&h->lock);
+        return NULL;
+}
+
+static inline void *
+classless_flushbuf_create_(size_t capacity, size_t elsize,
+    classless_flushbuf_sink_fn *sink, void *ctx, bool async)
+{
+        struct classless_flushbuf_header *h;
+        size_t header_size = (sizeof(*h) + sizeof(void *) + 63) & ~(size_t)63;
+        size_t halves = async ? 2 : 1;
+        size_t batch_size;
+
+        if (capacity == 0 || elsize == 0
+            || capacity > (SIZE_MAX - header_size) / halves / elsize)
+                return NULL;
+
+        batch_size = (capacity * elsize + 63) & ~(size_t)63;
+        if (batch_size > (SIZE_MAX - header_size) / halves)
+                return NULL;
+
+        if (posix_memalign((void **)&h, 64, header_size + halves * batch_size) != 0)
+                return NULL;
+
+        memset(h, 0, sizeof(*h));
+        h->sink = sink;
+        h->ctx = ctx;
+        h->elsize = elsize;
+        h->async = async;
+        h->slots[4 + CLS_BUF_IDX_SIZE_PTR] = &h->size;
+        h->slots[4 + CLS_BUF_IDX_CAPACITY] = (void *)(uintptr_t)capacity;
+        h->slots[4 + CLS_BUF_IDX_SIZE] = (void *)(uintptr_t)0;
+        h->slots[4 + CLS_BUF_IDX_DATA] = (char *)h + header_size;
+        *(void **)(h + 1) = NULL;
+        if (async) {
+                h->spare = (char *)h + header_size + batch_size;
+                if (pthread_mutex_init(&h->lock, NULL) != 0)
+                        goto out;
+                if (pthread_cond_init(&h->ready, NULL) != 0)
+                        goto lock;
+                if (pthread_cond_init(&h->drained, NULL) != 0)
+                        goto ready;
+                if (pthread_create(&h->thread, NULL, classless_flushbuf_thread_, h) != 0)
+                        goto drained;
+        }
+
+        return h + 1;
+
+drained:
+        pthread_cond_destroy(&h->drained);
+ready:
+        pthread_cond_destroy(&h->ready);
+lock:
+        pthread_mutex_destroy(&h->lock);
+out:
+        free(h);
+        return NULL;
+}
+
+static inline void
+classless_flushbuf_set_size_(struct classless_flushbuf_header *h, size_t size)
+{
+
+        h->size = size;
+        h->slots[4 + CLS_BUF_IDX_SIZE] = (void *)(uintptr_t)size;
+        return;
+}
+
+static inline bool
+classless_flushbuf_flush_(struct classless_flushbuf_header *h)
+{
+        void *data = h->slots[4 + CLS_BUF_IDX_DATA];
+        bool ok;
+
+        if (!h->async) {
+                if (h->failed)
+                        return false;
+
+                if (h->size > 0 && !h->sink(h->ctx, data, h->size, h->elsize)) {
+                        /* Keep the batch, so the caller can retry elsewhere. */
+                        h->failed = true;
+                        return false;
+                }
+
+                classless_flushbuf_set_size_(h, 0);
+                return true;
+        }
+
+        pthread_mutex_lock(&h->lock);
+        while (h->pending)
+                pthread_cond_wait(&h->drained, &h->lock);
+
+        ok = !h->failed;
+        if (ok && h->size > 0) {
+                h->pending_data = data;
+                h->pending_n = h->size;
+                h->pending = true;
+                pthread_cond_signal(&h->ready);
+
+                h->slots[4 + CLS_BUF_IDX_DATA] = h->spare;
+                h->spare = data;
+                classless_flushbuf_set_size_(h, 0);
+        }
+
+        pthread_mutex_unlock(&h->lock);
+        return ok;
+}
+
+static inline bool
+classless_flushbuf_drain_(struct classless_flushbuf_header *h)
+{
+        bool ok = classless_flushbuf_flush_(h);
+
+        if (!h->async)
+                return ok;
+
+        pthread_mutex_lock(&h->lock);
+        while (h->pending)
+                pthread_cond_wait(&h->drained, &h->lock);
+
+        ok = !h->failed;
+        pthread_mutex_unlock(&h->lock);
+        return ok;
+}
+
+static inline void *
+classless_flushbuf_reserve_(struct classless_flushbuf_header *h, size_t n)
+{
+        size_t capacity = (uintptr_t)h->slots[4 + CLS_BUF_IDX_CAPACITY];
+
+        if (n > capacity)
+                return NULL;
+
+        if (n > capacity - h->size && !classless_flushbuf_flush_(h))
+                return NULL;
+
+        return (char *)h->slots[4 + CLS_BUF_IDX_DATA] + h->size * h->elsize;
+}
+
+static inline bool
+classless_flushbuf_commit_(struct classless_flushbuf_header *h, size_t n)
+{
+        size_t capacity = (uintptr_t)h->slots[4 + CLS_BUF_IDX_CAPACITY];
+
+        if (n > capacity - h->size)
+                return false;
+
+        classless_flushbuf_set_size_(h, h->size + n);
+        return true;
+}
+
+static inline bool
+classless_flushbuf_destroy_(struct classless_flushbuf_header *h)
+{
+        bool ok;
+
+        if (h == NULL)
+                return true;
+
+        ok = classless_flushbuf_drain_(h);
+        if (h->async) {
+                pthread_mutex_lock(&h->lock);
+                h->stop = true;
+                pthread_cond_signal(&h->ready);
+                pthread_mutex_unlock(&h->lock);
+
+                pthread_join(h->thread, NULL);
+                pthread_cond_destroy(&h->drained);
+                pthread_cond_destroy(&h->ready);
+                pthread_mutex_destroy(&h->lock);
+        }
+
+        free(h);
+        return ok;
+}
+
+static inline bool
+classless_flushbuf_fd_sink_(void *ctx, const void *data, size_t n, size_t elsize)
+{
+        int fd = (int)(intptr_t)ctx;
+        const char *bytes = data;
+        size_t remaining = n * elsize;
+
+        while (remaining > 0) {
+                ssize_t written = write(fd, bytes, remaining);
+
+                if (written < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return false;
+                }
+
+                bytes += written;
+                remaining -= (size_t)written;
+        }
+
+        return true;
+}
+
+static inline bool
+classless_flushbuf_vec_sink_(void *ctx, const void *data, size_t n, size_t elsize)
+{
+        struct classless_vec_header *h = (struct classless_vec_header *)ctx - 1;
+
+        if (n > h->capacity - h->size)
+                return false;
+
+        memcpy((char *)ctx + h->size * elsize, data, n * elsize);
+        h->size += n;
+        return true;
+}
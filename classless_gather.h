@@ -0,0 +1,268 @@
+#pragma once
+/*
+ * Indexed gathers (`dst[i] = src[idx[i]]`) and scatters (`dst[idx[i]]
+ * = src[i]`) between bufs.
+ *
+ * Random accesses to large arrays are latency bound, so both loops
+ * prefetch the element CLS_BUF_GATHER_PREFETCH iterations ahead;
+ * define that macro before including this header to tune the
+ * distance.  When AVX2 is available, gathers of 4 and 8 byte elements
+ * with 32-bit indices use hardware gathers.
+ *
+ * Unlike `cls_buf_at`, indices are not checked one at a time: each
+ * call finds the largest index in the batch, compares it with the
+ * size of the indexed buf, and does nothing if it's out of range.
+ * Indices may be of any integer type; negative indices are always out
+ * of range.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#endif
+
+#include "classless.h"
+#include "classless_buf.h"
+
+#ifndef CLS_BUF_GATHER_PREFETCH
+# define CLS_BUF_GATHER_PREFETCH 16
+#endif
+
+typedef uint32_t classless_gather_u32_t __attribute__((__may_alias__));
+typedef uint64_t classless_gather_u64_t __attribute__((__may_alias__));
+
+/*
+ * Attempts to append `SRC[IDX[i]]` to the mutable buf `DST`, for each
+ * index in the view `IDX`.
+ *
+ * Returns true on success, does nothing and returns false if `DST`
+ * doesn't have room for all the elements, or if any index is out of
+ * range for `SRC`.
+ */
+#define cls_buf_gather(DST, SRC, IDX)                                   \
+        ({                                                              \
+                CLS_LET(cls_gather_dst_, (DST));                        \
+                CLS_LET(cls_gather_src_, (SRC));                        \
+                CLS_LET(cls_gather_idx_, (IDX));                        \
+                CLS_MUTABLE_TAG_CHECK(classless_buf, cls_gather_dst_);  \
+                CLS_TAG_CHECK(classless_buf, cls_gather_src_);          \
+                CLS_TAG_CHECK(classless_buf, cls_gather_idx_);          \
+                CLS_BUF_GATHER_CHECK_INDEX_(**cls_gather_idx_);         \
+                const __typeof__(**cls_gather_dst_) *cls_gather_src_data_ = \
+                        cls_buf_data(cls_gather_src_);                  \
+                const __typeof__(**cls_gather_idx_) *cls_gather_idx_data_ = \
+                        cls_buf_data(cls_gather_idx_);                  \
+                size_t cls_gather_n_ = cls_buf_size(cls_gather_idx_);   \
+                __typeof__(**cls_gather_dst_) *cls_gather_out_ =        \
+                        cls_buf_reserve(cls_gather_dst_, cls_gather_n_); \
+                bool cls_gather_ok_ = (cls_gather_out_ != NULL)         \
+                        && CLS_BUF_GATHER_IN_RANGE_(cls_gather_idx_data_, cls_gather_n_, \
+                                                    cls_buf_size(cls_gather_src_)); \
+                                                                        \
+                if (cls_gather_ok_)                                     \
+                        CLS_BUF_GATHER_(cls_gather_out_, cls_gather_src_data_, \
+                                        cls_buf_size(cls_gather_src_),  \
+                                        cls_gather_idx_data_, cls_gather_n_); \
+                                                                        \
+                cls_gather_ok_ && cls_buf_commit(cls_gather_dst_, cls_gather_n_); \
+        })
+
+/*
+ * Attempts to overwrite `DST[IDX[i]]` with `SRC[i]`, for each index in
+ * the view `IDX`.  `DST` is a read-write view (or a buf) and `SRC` must
+ * have at least as many elements as `IDX`.  When indices repeat, the
+ * last write wins.
+ *
+ * Returns true on success, does nothing and returns false if `SRC` is
+ * too short, or if any index is out of range for `DST`.
+ */
+#define cls_buf_scatter(DST, IDX, SRC)                                  \
+        ({                                                              \
+                CLS_LET(cls_gather_dst_, (DST));                        \
+                CLS_LET(cls_gather_idx_, (IDX));                        \
+                CLS_LET(cls_gather_src_, (SRC));                        \
+                CLS_TAG_CHECK(classless_buf, cls_gather_dst_);          \
+                CLS_TAG_CHECK(classless_buf, cls_gather_idx_);          \
+                CLS_TAG_CHECK(classless_buf, cls_gather_src_);          \
+                CLS_BUF_GATHER_CHECK_INDEX_(**cls_gather_idx_);         \
+                __typeof__(**cls_gather_dst_) *cls_gather_out_ =        \
+                        cls_buf_data(cls_gather_dst_);                  \
+                const __typeof__(**cls_gather_dst_) *cls_gather_src_data_ = \
+                        cls_buf_data(cls_gather_src_);                  \
+                const __typeof__(**cls_gather_idx_) *cls_gather_idx_data_ = \
+                        cls_buf_data(cls_gather_idx_);                  \
+                size_t cls_gather_n_ = cls_buf_size(cls_gather_idx_);   \
+                bool cls_gather_ok_ = (cls_gather_n_ <= cls_buf_size(cls_gather_src_)) \
+                        && CLS_BUF_GATHER_IN_RANGE_(cls_gather_idx_data_, cls_gather_n_, \
+                                                    cls_buf_size(cls_gather_dst_)); \
+                                                                        \
+                if (cls_gather_ok_) {                                   \
+                        size_t cls_gather_i_ = 0;                       \
+                                                                        \
+                        for (; cls_gather_i_ + CLS_BUF_GATHER_PREFETCH < cls_gather_n_; \
+                             cls_gather_i_++) {                         \
+                                __builtin_prefetch(&cls_gather_out_[    \
+                                        cls_gather_idx_data_[cls_gather_i_ \
+                                                          + CLS_BUF_GATHER_PREFETCH]], 1); \
+                                cls_gather_out_[cls_gather_idx_data_[cls_gather_i_]] = \
+                                        cls_gather_src_data_[cls_gather_i_]; \
+                        }                                               \
+                                                                        \
+                        for (; cls_gather_i_ < cls_gather_n_; cls_gather_i_++) \
+                                cls_gather_out_[cls_gather_idx_data_[cls_gather_i_]] = \
+                                        cls_gather_src_data_[cls_gather_i_]; \
+                }                                                       \
+                                                                        \
+                cls_gather_ok_;                                         \
+        })
+
+/*
+ * Gathers N elements from SRC (of SRC_SIZE elements) to OUT, with
+ * in-range indices IDX.
+ */
+#define CLS_BUF_GATHER_(OUT, SRC, SRC_SIZE, IDX, N)                     \
+        ({                                                              \
+                CLS_LET(cls_gather_g_out_, (OUT));                      \
+                CLS_LET(cls_gather_g_src_, (SRC));                      \
+                size_t cls_gather_g_src_size_ = (SRC_SIZE);             \
+                CLS_LET(cls_gather_g_idx_, (IDX));                      \
+                size_t cls_gather_g_n_ = (N);                           \
+                size_t cls_gather_g_i_ = 0;                             \
+                                                                        \
+                if (sizeof(*cls_gather_g_out_) == sizeof(uint32_t)      \
+                    && sizeof(*cls_gather_g_idx_) == sizeof(uint32_t)) { \
+                        cls_gather_g_i_ = classless_gather_u32_(        \
+                                (void *)cls_gather_g_out_,              \
+                                (const void *)cls_gather_g_src_,        \
+                                cls_gather_g_src_size_,                 \
+                                (const void *)cls_gather_g_idx_,        \
+                                cls_gather_g_n_);                       \
+                } else if (sizeof(*cls_gather_g_out_) == sizeof(uint64_t) \
+                           && sizeof(*cls_gather_g_idx_) == sizeof(uint32_t)) { \
+                        cls_gather_g_i_ = classless_gather_u64_(        \
+                                (void *)cls_gather_g_out_,              \
+                                (const void *)cls_gather_g_src_,        \
+                                cls_gather_g_src_size_,                 \
+                                (const void *)cls_gather_g_idx_,        \
+                                cls_gather_g_n_);                       \
+                }                                                       \
+                                                                        \
+                for (; cls_gather_g_i_ + CLS_BUF_GATHER_PREFETCH < cls_gather_g_n_; \
+                     cls_gather_g_i_++) {                               \
+                        __builtin_prefetch(&cls_gather_g_src_[          \
+                                cls_gather_g_idx_[cls_gather_g_i_ + CLS_BUF_GATHER_PREFETCH]]); \
+                        cls_gather_g_out_[cls_gather_g_i_] =            \
+                                cls_gather_g_src_[cls_gather_g_idx_[cls_gather_g_i_]]; \
+                }                                                       \
+                                                                        \
+                for (; cls_gather_g_i_ < cls_gather_g_n_; cls_gather_g_i_++) \
+                        cls_gather_g_out_[cls_gather_g_i_] =            \
+                                cls_gather_g_src_[cls_gather_g_idx_[cls_gather_g_i_]]; \
+        })
+
+#define CLS_BUF_GATHER_CHECK_INDEX_(T)                                  \
+        _Static_assert((__typeof__(T))1 / 2 == 0,                       \
+                       "Gather and scatter indices must be integers.")
+
+/*
+ * True if all N indices in IDX (converted to size_t) are less than
+ * SIZE.  The reduction is branch-free, and vectorises.
+ */
+#define CLS_BUF_GATHER_IN_RANGE_(IDX, N, SIZE)                          \
+        ({                                                              \
+                CLS_LET(cls_gather_range_idx_, (IDX));                  \
+                size_t cls_gather_range_n_ = (N);                       \
+                size_t cls_gather_range_max_ = 0;                       \
+                                                                        \
+                for (size_t cls_gather_range_i_ = 0;                    \
+                     cls_gather_range_i_ < cls_gather_range_n_;         \
+                     cls_gather_range_i_++) {                           \
+                        size_t cls_gather_range_x_ =                    \
+                                (size_t)cls_gather_range_idx_[cls_gather_range_i_]; \
+                                                                        \
+                        cls_gather_range_max_ =                         \
+                                (cls_gather_range_x_ > cls_gather_range_max_) \
+                                ? cls_gather_range_x_ : cls_gather_range_max_; \
+                }                                                       \
+                                                                        \
+                cls_gather_range_n_ == 0 || cls_gather_range_max_ < (SIZE); \
+        })
+
+/*
+ * Gathers as many 32-bit elements as possible with AVX2, and returns
+ * the number of elements gathered; the caller handles the rest.
+ */
+static inline size_t
+classless_gather_u32_(classless_gather_u32_t *dst, const classless_gather_u32_t *src,
+    size_t src_size, const classless_gather_u32_t *idx, size_t n)
+{
+        size_t i = 0;
+
+#if defined(__AVX2__)
+        /*
+         * Hardware gathers take signed 32-bit indices, and we know
+         * all indices are less than src_size.
+         */
+        if (src_size > (size_t)INT32_MAX + 1)
+                return 0;
+
+        for (; i + 8 <= n; i += 8) {
+                __m256i vidx = _mm256_loadu_si256((const void *)&idx[i]);
+
+                if (i + 8 + CLS_BUF_GATHER_PREFETCH <= n) {
+                        for (size_t j = 0; j < 8; j++)
+                                __builtin_prefetch(&src[idx[i + j + CLS_BUF_GATHER_PREFETCH]]);
+                }
+
+                _mm256_storeu_si256((void *)&dst[i],
+                    _mm256_i32gather_epi32((const void *)src, vidx, 4));
+        }
+#else
+        (void)dst;
+        (void)src;
+        (void)src_size;
+        (void)idx;
+        (void)n;
+#endif
+
+        return i;
+}
+
+/*
+ * Gathers as many 64-bit elements as possible with AVX2, and returns
+ * the number of elements gathered.
+ */
+static inline size_t
+classless_gather_u64_(classless_gather_u64_t *dst, const classless_gather_u64_t *src,
+    size_t src_size, const classless_gather_u32_t *idx, size_t n)
+{
+        size_t i = 0;
+
+#if defined(__AVX2__)
+        if (src_size > (size_t)INT32_MAX + 1)
+                return 0;
+
+        for (; i + 4 <= n; i += 4) {
+                __m128i vidx = _mm_loadu_si128((const void *)&idx[i]);
+
+                if (i + 4 + CLS_BUF_GATHER_PREFETCH <= n) {
+                        for (size_t j = 0; j < 4; j++)
+                                __builtin_prefetch(&src[idx[i + j + CLS_BUF_GATHER_PREFETCH]]);
+                }
+
+                _mm256_storeu_si256((void *)&dst[i],
+                    _mm256_i32gather_epi64((const void *)src, vidx, 8));
+        }
+#else
+        (void)dst;
+        (void)src;
+        (void)src_size;
+        (void)idx;
+        (void)n;
+#endif
+
+        return i;
+}
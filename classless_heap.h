@@ -0,0 +1,382 @@
+#pragma once
+/*
+ * A heap is a fixed-capacity d-ary min-heap.  It uses the same
+ * storage (and header) as a vec, but a different tag: vec operations
+ * would happily break the heap property.
+ *
+ * The arity defaults to 4.  Siblings are contiguous, so each level of
+ * a sift-down scans one run of children (a cache line for small
+ * elements), and the tree is half as deep as a binary heap.  Define
+ * CLS_HEAP_ARITY before including this header to override it; 8 also
+ * fits in a cache line for 8-byte elements.
+ *
+ * The order is defined by a LESS argument: a function or function-like
+ * macro such that `LESS(A, B)` is true when the element value A must
+ * be closer to the top than B.  LESS is expanded inline, so it should
+ * be cheap.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "classless.h"
+#include "classless_buf.h"
+#include "classless_vec.h"
+
+#ifndef CLS_HEAP_ARITY
+# define CLS_HEAP_ARITY 4
+#endif
+
+_Static_assert(CLS_HEAP_ARITY >= 2, "Heaps must have at least 2 children per node.");
+
+/*
+ * cls_topk scans its input in blocks of that many elements, and skips
+ * blocks that can't affect the heap.
+ */
+#ifndef CLS_TOPK_BLOCK
+# define CLS_TOPK_BLOCK 16
+#endif
+
+/*
+ * The pointer to the data array is tagged with address space 102.
+ */
+CLS_TAG_REGISTER(classless_heap, 102);
+
+/*
+ * A heap is `T cls_heap *`.
+ */
+#define cls_heap CLS_TAG(classless_heap)
+
+/*
+ * Allocates an empty heap of T with the specified capacity, or
+ * returns NULL on allocation failure.
+ */
+#define cls_heap_create(T, CAPACITY)                                    \
+        ((__typeof__(T) cls_heap *) classless_vec_create_((CAPACITY), sizeof(T)))
+
+/*
+ * Deallocates a heap.  Safe to call on NULL.
+ */
+#define cls_heap_destroy(HEAP)                                          \
+        ({                                                              \
+                CLS_LET(cls_heap_, (HEAP));                             \
+                CLS_MUTABLE_TAG_CHECK(classless_heap, cls_heap_);       \
+                                                                        \
+                classless_vec_destroy_(CLS_TAG_STRIPPED(classless_heap, cls_heap_)); \
+        })
+
+#define cls_heap_size(HEAP)                                             \
+        ({                                                              \
+                CLS_LET(cls_heap_, (HEAP));                             \
+                CLS_TAG_CHECK(classless_heap, cls_heap_);               \
+                                                                        \
+                (cls_heap_ == NULL)                                     \
+                ? 0                                                     \
+                : CLS_HEADER_OF(classless_vec_header, cls_heap_)->size; \
+        })
+
+#define cls_heap_capacity(HEAP)                                         \
+        ({                                                              \
+                CLS_LET(cls_heap_, (HEAP));                             \
+                CLS_TAG_CHECK(classless_heap, cls_heap_);               \
+                                                                        \
+                (cls_heap_ == NULL)                                     \
+                ? 0                                                     \
+                : CLS_HEADER_OF(classless_vec_header, cls_heap_)->capacity; \
+        })
+
+/*
+ * Returns a pointer to the top (least) element in the heap, or NULL
+ * if the heap is empty.
+ */
+#define cls_heap_top(HEAP)                                              \
+        ({                                                              \
+                CLS_LET(cls_heap_, (HEAP));                             \
+                CLS_TAG_CHECK(classless_heap, cls_heap_);               \
+                CLS_LET_HEADER(classless_vec_header, cls_heap_h_, cls_heap_); \
+                                                                        \
+                (cls_heap_h_->size > 0)                                 \
+                        ? &CLS_TAG_STRIPPED(classless_heap, cls_heap_)[0] \
+                        : NULL;                                         \
+        })
+
+/*
+ * Converts a heap to a const view of its elements, in heap order.
+ *
+ * Like `cls_buf_const_view`, the result must be used directly as a
+ * function argument; HEAP is evaluated more than once.
+ */
+#define cls_heap_const_view(HEAP)                                       \
+        cls_buf_const_view(CLS_HEAP_VIEW_((HEAP)))
+
+/*
+ * The block must be a compound literal in the caller's scope: one in
+ * a statement expression would not outlive the expression.
+ */
+#define CLS_HEAP_VIEW_(HEAP)                                            \
+        cls_buf_block(&CLS_TAG_STRIPPED(classless_heap, (HEAP))[0],     \
+                      NULL,                                             \
+                      CLS_HEADER_OF(classless_vec_header, (HEAP))->size, \
+                      CLS_HEADER_OF(classless_vec_header, (HEAP))->capacity)
+
+/*
+ * Attempts to insert `X` in the heap.
+ *
+ * Returns true on success, false if the heap is at capacity.
+ */
+#define cls_heap_push(HEAP, X, LESS)                                    \
+        ({                                                              \
+                CLS_LET(cls_heap_, (HEAP));                             \
+                CLS_MUTABLE_TAG_CHECK(classless_heap, cls_heap_);       \
+                __typeof__(*CLS_TAG_STRIPPED(classless_heap, cls_heap_)) \
+                        cls_heap_x_ = (X);                              \
+                CLS_LET_STRIPPED(classless_heap, cls_heap_ptr_, cls_heap_); \
+                CLS_LET_HEADER(classless_vec_header, cls_heap_h_, cls_heap_); \
+                bool cls_heap_ok_ = cls_heap_h_->size < cls_heap_h_->capacity; \
+                                                                        \
+                if (cls_heap_ok_)                                       \
+                        CLS_HEAP_SIFT_UP_(cls_heap_ptr_, cls_heap_h_->size++, \
+                                          cls_heap_x_, LESS);           \
+                cls_heap_ok_;                                           \
+        })
+
+/*
+ * Attempts to remove the top element from the heap.
+ *
+ * Returns true on success, false if the heap is empty.
+ */
+#define cls_heap_pop(HEAP, LESS)                                        \
+        ({                                                              \
+                CLS_LET(cls_heap_, (HEAP));                             \
+                CLS_MUTABLE_TAG_CHECK(classless_heap, cls_heap_);       \
+                CLS_LET_STRIPPED(classless_heap, cls_heap_ptr_, cls_heap_); \
+                CLS_LET_HEADER(classless_vec_header, cls_heap_h_, cls_heap_); \
+                bool cls_heap_ok_ = cls_heap_h_->size > 0;              \
+                                                                        \
+                if (cls_heap_ok_ && --cls_heap_h_->size > 0)            \
+                        CLS_HEAP_SIFT_DOWN_(cls_heap_ptr_, cls_heap_h_->size, 0, \
+                                            cls_heap_ptr_[cls_heap_h_->size], \
+                                            LESS);                      \
+                cls_heap_ok_;                                           \
+        })
+
+/*
+ * Attempts to replace the top element in the heap with `X`.  This is
+ * equivalent to, but about twice as fast as, a pop followed by a push.
+ *
+ * Returns true on success, false if the heap is empty.
+ */
+#define cls_heap_replace_top(HEAP, X, LESS)                             \
+        ({                                                              \
+                CLS_LET(cls_heap_, (HEAP));                             \
+                CLS_MUTABLE_TAG_CHECK(classless_heap, cls_heap_);       \
+                __typeof__(*CLS_TAG_STRIPPED(classless_heap, cls_heap_)) \
+                        cls_heap_x_ = (X);                              \
+                CLS_LET_STRIPPED(classless_heap, cls_heap_ptr_, cls_heap_); \
+                CLS_LET_HEADER(classless_vec_header, cls_heap_h_, cls_heap_); \
+                bool cls_heap_ok_ = cls_heap_h_->size > 0;              \
+                                                                        \
+                if (cls_heap_ok_)                                       \
+                        CLS_HEAP_SIFT_DOWN_(cls_heap_ptr_, cls_heap_h_->size, 0, \
+                                            cls_heap_x_, LESS);         \
+                cls_heap_ok_;                                           \
+        })
+
+/*
+ * Attempts to insert all the elements in `VIEW` in the heap.
+ *
+ * Large batches are heapified bottom-up in linear time, small ones
+ * are pushed one at a time.
+ *
+ * Returns true on success, does nothing and returns false if the heap
+ * does not have enough room left.
+ */
+#define cls_heap_heapify(HEAP, VIEW, LESS)                              \
+        ({                                                              \
+                CLS_LET(cls_heap_, (HEAP));                             \
+                CLS_LET(cls_heap_src_, (VIEW));                         \
+                CLS_MUTABLE_TAG_CHECK(classless_heap, cls_heap_);       \
+                CLS_TAG_CHECK(classless_buf, cls_heap_src_);            \
+                CLS_LET_STRIPPED(classless_heap, cls_heap_ptr_, cls_heap_); \
+                CLS_LET_HEADER(classless_vec_header, cls_heap_h_, cls_heap_); \
+                const __typeof__(*cls_heap_ptr_) *cls_heap_src_data_ =  \
+                        cls_buf_data(cls_heap_src_);                    \
+                size_t cls_heap_n_ = cls_buf_size(cls_heap_src_);       \
+                size_t cls_heap_old_ = cls_heap_h_->size;               \
+                bool cls_heap_ok_ =                                     \
+                        cls_heap_n_ <= cls_heap_h_->capacity - cls_heap_old_; \
+                                                                        \
+                if (cls_heap_ok_ && cls_heap_n_ > 0) {                  \
+                        memcpy(&cls_heap_ptr_[cls_heap_old_], cls_heap_src_data_, \
+                               cls_heap_n_ * sizeof(*cls_heap_ptr_));   \
+                        cls_heap_h_->size += cls_heap_n_;               \
+                        if (cls_heap_n_ <= cls_heap_old_) {             \
+                                for (size_t cls_heap_i_ = cls_heap_old_; \
+                                     cls_heap_i_ < cls_heap_h_->size;   \
+                                     cls_heap_i_++)                     \
+                                        CLS_HEAP_SIFT_UP_(cls_heap_ptr_, cls_heap_i_, \
+                                                          cls_heap_ptr_[cls_heap_i_], \
+                                                          LESS);        \
+                        } else {                                        \
+                                for (size_t cls_heap_i_ =               \
+                                             (cls_heap_h_->size + CLS_HEAP_ARITY - 2) \
+                                             / CLS_HEAP_ARITY;          \
+                                     cls_heap_i_-- > 0; )               \
+                                        CLS_HEAP_SIFT_DOWN_(cls_heap_ptr_, \
+                                                            cls_heap_h_->size, \
+                                                            cls_heap_i_, \
+                                                            cls_heap_ptr_[cls_heap_i_], \
+                                                            LESS);      \
+                        }                                               \
+                }                                                       \
+                                                                        \
+                cls_heap_ok_;                                           \
+        })
+
+/*
+ * Streams `VIEW` through the heap, and leaves the heap with the
+ * `cls_heap_capacity(HEAP)` greatest elements (according to LESS) out
+ * of the heap's initial contents and `VIEW`.  The top of the heap is
+ * thus the least element that made the cut.
+ *
+ * Once the heap is full, the view is scanned in blocks of
+ * CLS_TOPK_BLOCK elements, with a branch-free comparison of the whole
+ * block against the current top; for simple LESS on arithmetic types,
+ * compilers turn that precheck into SIMD compares.  Only blocks with
+ * at least one candidate hit the heap.
+ */
+#define cls_topk(HEAP, VIEW, LESS)                                      \
+        ({                                                              \
+                CLS_LET(cls_heap_, (HEAP));                             \
+                CLS_LET(cls_heap_src_, (VIEW));                         \
+                CLS_MUTABLE_TAG_CHECK(classless_heap, cls_heap_);       \
+                CLS_TAG_CHECK(classless_buf, cls_heap_src_);            \
+                CLS_LET_STRIPPED(classless_heap, cls_heap_ptr_, cls_heap_); \
+                CLS_LET_HEADER(classless_vec_header, cls_heap_h_, cls_heap_); \
+                const __typeof__(*cls_heap_ptr_) *cls_heap_src_data_ =  \
+                        cls_buf_data(cls_heap_src_);                    \
+                size_t cls_heap_n_ = cls_buf_size(cls_heap_src_);       \
+                size_t cls_heap_i_ = 0;                                 \
+                                                                        \
+                for (; cls_heap_i_ < cls_heap_n_                        \
+                             && cls_heap_h_->size < cls_heap_h_->capacity; \
+                     cls_heap_i_++)                                     \
+                        CLS_HEAP_SIFT_UP_(cls_heap_ptr_, cls_heap_h_->size++, \
+                                          cls_heap_src_data_[cls_heap_i_], \
+                                          LESS);                        \
+                                                                        \
+                if (cls_heap_h_->size == 0)                             \
+                        cls_heap_i_ = cls_heap_n_;                      \
+                                                                        \
+                while (cls_heap_i_ < cls_heap_n_) {                     \
+                        size_t cls_heap_end_ = cls_heap_n_;             \
+                                                                        \
+                        if (cls_heap_n_ - cls_heap_i_ >= CLS_TOPK_BLOCK) { \
+                                bool cls_heap_any_ = false;             \
+                                                                        \
+                                for (size_t cls_heap_j_ = 0;            \
+                                     cls_heap_j_ < CLS_TOPK_BLOCK;      \
+                                     cls_heap_j_++)                     \
+                                        cls_heap_any_ |=                \
+                                                LESS(cls_heap_ptr_[0],  \
+                                                     cls_heap_src_data_[cls_heap_i_ \
+                                                                        + cls_heap_j_]); \
+                                                                        \
+                                cls_heap_end_ = cls_heap_i_ + CLS_TOPK_BLOCK; \
+                                if (!cls_heap_any_) {                   \
+                                        cls_heap_i_ = cls_heap_end_;    \
+                                        continue;                       \
+                                }                                       \
+                        }                                               \
+                                                                        \
+                        for (; cls_heap_i_ < cls_heap_end_; cls_heap_i_++) { \
+                                if (LESS(cls_heap_ptr_[0],              \
+                                         cls_heap_src_data_[cls_heap_i_])) \
+                                        CLS_HEAP_SIFT_DOWN_(cls_heap_ptr_, \
+                                                            cls_heap_h_->size, \
+                                                            0,          \
+                                                            cls_heap_src_data_[cls_heap_i_], \
+                                                            LESS);      \
+                        }                                               \
+                }                                                       \
+        })
+
+/*
+ * Inserts X at index I in the heap rooted at PTR, and moves it up
+ * until the heap property is restored.  The initial value at I is
+ * ignored.
+ */
+#define CLS_HEAP_SIFT_UP_(PTR, I, X, LESS)                              \
+        ({                                                              \
+                CLS_LET(cls_heap_su_ptr_, (PTR));                       \
+                size_t cls_heap_su_i_ = (I);                            \
+                __typeof__(*cls_heap_su_ptr_) cls_heap_su_x_ = (X);     \
+                                                                        \
+                while (cls_heap_su_i_ > 0) {                            \
+                        size_t cls_heap_su_parent_ =                    \
+                                (cls_heap_su_i_ - 1) / CLS_HEAP_ARITY;  \
+                                                                        \
+                        if (!LESS(cls_heap_su_x_,                       \
+                                  cls_heap_su_ptr_[cls_heap_su_parent_])) \
+                                break;                                  \
+                                                                        \
+                        cls_heap_su_ptr_[cls_heap_su_i_] =              \
+                                cls_heap_su_ptr_[cls_heap_su_parent_];  \
+                        cls_heap_su_i_ = cls_heap_su_parent_;           \
+                }                                                       \
+                                                                        \
+                cls_heap_su_ptr_[cls_heap_su_i_] = cls_heap_su_x_;      \
+        })
+
+/*
+ * Inserts X at index I in the heap of N elements rooted at PTR, and
+ * moves it down until the heap property is restored.  The initial
+ * value at I is ignored.
+ *
+ * The least child is selected with a conditional move, so only the
+ * comparison against X is a (predictable) branch.
+ */
+#define CLS_HEAP_SIFT_DOWN_(PTR, N, I, X, LESS)                         \
+        ({                                                              \
+                CLS_LET(cls_heap_sd_ptr_, (PTR));                       \
+                size_t cls_heap_sd_n_ = (N);                            \
+                size_t cls_heap_sd_i_ = (I);                            \
+                __typeof__(*cls_heap_sd_ptr_) cls_heap_sd_x_ = (X);     \
+                                                                        \
+                for (;;) {                                              \
+                        size_t cls_heap_sd_first_ =                     \
+                                cls_heap_sd_i_ * CLS_HEAP_ARITY + 1;    \
+                        size_t cls_heap_sd_last_;                       \
+                        size_t cls_heap_sd_best_;                       \
+                                                                        \
+                        if (cls_heap_sd_first_ >= cls_heap_sd_n_)       \
+                                break;                                  \
+                                                                        \
+                        cls_heap_sd_last_ =                             \
+                                (cls_heap_sd_n_ - cls_heap_sd_first_ < CLS_HEAP_ARITY) \
+                                ? cls_heap_sd_n_                        \
+                                : cls_heap_sd_first_ + CLS_HEAP_ARITY;  \
+                        cls_heap_sd_best_ = cls_heap_sd_first_;         \
+                        for (size_t cls_heap_sd_c_ = cls_heap_sd_first_ + 1; \
+                             cls_heap_sd_c_ < cls_heap_sd_last_;        \
+                             cls_heap_sd_c_++)                          \
+                                cls_heap_sd_best_ =                     \
+                                        LESS(cls_heap_sd_ptr_[cls_heap_sd_c_], \
+                                             cls_heap_sd_ptr_[cls_heap_sd_best_]) \
+                                        ? cls_heap_sd_c_                \
+                                        : cls_heap_sd_best_;            \
+                                                                        \
+                        if (!LESS(cls_heap_sd_ptr_[cls_heap_sd_best_],  \
+                                  cls_heap_sd_x_))                      \
+                                break;                                  \
+                                                                        \
+                        cls_heap_sd_ptr_[cls_heap_sd_i_] =              \
+                                cls_heap_sd_ptr_[cls_heap_sd_best_];    \
+                        cls_heap_sd_i_ = cls_heap_sd_best_;             \
+                }                                                       \
+                                                                        \
+                cls_heap_sd_ptr_[cls_heap_sd_i_] = cls_heap_sd_x_;      \
+        })
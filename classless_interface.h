@@ -1,5 +1,9 @@
 #pragma once
 
-#ifdef __clang__
+/*
+ * The registry only needs `_Generic` and `__typeof__`, so it works
+ * with any GNU C compiler, not only clang.
+ */
+#ifdef __GNUC__
 # include "classless_interface_clang.h"
 #endif
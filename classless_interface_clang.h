@@ -1,12 +1,21 @@
 #pragma once
 
 /*
- * static const struct { 
- *     ...
- * }
+ * An interface is a static const struct of function pointers, with a
+ * dummy `element` pointer member that determines the element type it
+ * applies to.  Register one by including CLS_INTF_REGISTER between the
+ * members and the initializers:
+ *
+ * static const struct {
+ *     const struct point *element;
+ *     int (*compare)(const struct point *, const struct point *);
  * #include CLS_INTF_REGISTER
- * {
+ *     .compare = point_compare,
  * };
+ *
+ * Each registration includes the next header in a chain generated by
+ * `classless_interface_clang/generate.py`, currently up to 64
+ * interfaces per translation unit.
  */
 
 #define CLS_INTF_REGISTER "classless_interface_clang/intf1.h"
@@ -16,3 +25,16 @@
 #define CLS_INTF_FIND(T, DEFAULT) (DEFAULT)
 
 #define CLS_INTF_FROM_INDEX(I, DEFAULT) (DEFAULT)
+
+/*
+ * Calls METHOD in the interface registered for the pointee type of
+ * OBJ, with OBJ and the remaining arguments.  The interface is found
+ * at compile time, and its members are constants, so this compiles to
+ * a direct (and inlinable) call; e.g.,
+ *
+ *     CLS_INTF_CALL(&points[i], compare, &points[j])
+ *
+ * Fails to compile if no interface is registered for the type.
+ */
+#define CLS_INTF_CALL(OBJ, METHOD, ...)                                 \
+        CLS_INTF_FIND(*(OBJ), (void)0).METHOD((OBJ), ##__VA_ARGS__)
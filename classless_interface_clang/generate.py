@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""
+Generates the chain of interface registration headers, intf1.h to
+intfN.h, and an intf(N+1).h that fails the build.
+
+Each intfK.h closes the K'th interface's type, redefines the lookup
+macros to cover interfaces 1 to K, points CLS_INTF_REGISTER at the
+next header, and opens the definition of the K'th interface.
+
+Usage: generate.py [DEPTH [DIRECTORY]]
+"""
+
+import os
+import sys
+
+DEFAULT_DEPTH = 64
+
+
+def macro(lines):
+    """Joins lines with backslashes aligned on column 73."""
+    out = []
+    for line in lines[:-1]:
+        out.append(line.ljust(71) + " \\")
+    out.append(lines[-1])
+    return "\n".join(out)
+
+
+def header(k):
+    parts = []
+    parts.append("""#ifdef CLASSLESS_INTERFACE_INTF{k}
+# error "Multiple (direct?) inclusion."
+#endif
+
+#define CLASSLESS_INTERFACE_INTF{k}
+
+}} classless_intf{k};
+
+typedef const __typeof__(classless_intf{k}) classless_intf{k}_t;
+typedef const __typeof__(*classless_intf{k}.element) classless_intf{k}_element_t;
+""".format(k=k))
+
+    if k > 1:
+        parts.append("""_Static_assert(CLS_INTF_FIND(classless_intf{k}_t, 0) == 0,
+    "Interface types must only be registered once.");
+
+_Static_assert(CLS_INTF_FIND(classless_intf{k}_element_t, 0) == 0,
+    "Only one interface type may be registered for each element type.");
+""".format(k=k))
+
+    to_index = ["#define CLS_INTF_TO_INDEX(INTF, DEFAULT)",
+                "        _Generic((const __typeof__(INTF) *)0,"]
+    to_index += ["                 classless_intf%d_t *: %d," % (i, i)
+                 for i in range(1, k + 1)]
+    to_index += ["                 default: (DEFAULT))"]
+    parts.append("#undef CLS_INTF_TO_INDEX\n" + macro(to_index) + "\n")
+
+    find = ["#define CLS_INTF_FIND(T, DEFAULT)",
+            "        _Generic((const __typeof__(T) *)0,"]
+    find += ["                 classless_intf%d_t *: classless_intf%d," % (i, i)
+             for i in range(k, 0, -1)]
+    find += ["                 default:",
+             "                 _Generic((const __typeof(T) *)0,"]
+    find += ["                          classless_intf%d_element_t *: classless_intf%d," % (i, i)
+             for i in range(1, k + 1)]
+    find += ["                          default: (DEFAULT)))"]
+    parts.append("#undef CLS_INTF_FIND\n" + macro(find) + "\n")
+
+    from_index = ["#define CLS_INTF_FROM_INDEX(I, DEFAULT)",
+                  "        _Generic((const char(*)[(I)])0,"]
+    from_index += ["                 const char(*)[%d]: classless_intf%d," % (i, i)
+                   for i in range(1, k + 1)]
+    from_index += ["                 default: (DEFAULT))"]
+    parts.append("#undef CLS_INTF_FROM_INDEX\n" + macro(from_index) + "\n")
+
+    parts.append("""#undef CLS_INTF_REGISTER
+#define CLS_INTF_REGISTER "classless_interface_clang/intf{next}.h"
+
+__attribute__((__unused__)) static const classless_intf{k}_t classless_intf{k} = {{""".format(
+        k=k, next=k + 1))
+
+    return "\n".join(parts) + "\n"
+
+
+def overflow(depth):
+    return """#error "Too many interfaces: the registry only supports {depth}, see generate.py."
+""".format(depth=depth)
+
+
+def main():
+    depth = int(sys.argv[1]) if len(sys.argv) > 1 else DEFAULT_DEPTH
+    directory = sys.argv[2] if len(sys.argv) > 2 else os.path.dirname(os.path.abspath(__file__))
+
+    for k in range(1, depth + 1):
+        with open(os.path.join(directory, "intf%d.h" % k), "w") as f:
+            f.write(header(k))
+
+    with open(os.path.join(directory, "intf%d.h" % (depth + 1)), "w") as f:
+        f.write(overflow(depth))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,86 @@
+#ifdef CLASSLESS_INTERFACE_INTF12
+# error "Multiple (direct?) inclusion."
+#endif
+
+#define CLASSLESS_INTERFACE_INTF12
+
+} classless_intf12;
+
+typedef const __typeof__(classless_intf12) classless_intf12_t;
+typedef const __typeof__(*classless_intf12.element) classless_intf12_element_t;
+
+_Static_assert(CLS_INTF_FIND(classless_intf12_t, 0) == 0,
+    "Interface types must only be registered once.");
+
+_Static_assert(CLS_INTF_FIND(classless_intf12_element_t, 0) == 0,
+    "Only one interface type may be registered for each element type.");
+
+#undef CLS_INTF_TO_INDEX
+#define CLS_INTF_TO_INDEX(INTF, DEFAULT)                                \
+        _Generic((const __typeof__(INTF) *)0,                           \
+                 classless_intf1_t *: 1,                                \
+                 classless_intf2_t *: 2,                                \
+                 classless_intf3_t *: 3,                                \
+                 classless_intf4_t *: 4,                                \
+                 classless_intf5_t *: 5,                                \
+                 classless_intf6_t *: 6,                                \
+                 classless_intf7_t *: 7,                                \
+                 classless_intf8_t *: 8,                                \
+                 classless_intf9_t *: 9,                                \
+                 classless_intf10_t *: 10,                              \
+                 classless_intf11_t *: 11,                              \
+                 classless_intf12_t *: 12,                              \
+                 default: (DEFAULT))
+
+#undef CLS_INTF_FIND
+#define CLS_INTF_FIND(T, DEFAULT)                                       \
+        _Generic((const __typeof__(T) *)0,                              \
+                 classless_intf12_t *: classless_intf12,                \
+                 classless_intf11_t *: classless_intf11,                \
+                 classless_intf10_t *: classless_intf10,                \
+                 classless_intf9_t *: classless_intf9,                  \
+                 classless_intf8_t *: classless_intf8,                  \
+                 classless_intf7_t *: classless_intf7,                  \
+                 classless_intf6_t *: classless_intf6,                  \
+                 classless_intf5_t *: classless_intf5,                  \
+                 classless_intf4_t *: classless_intf4,                  \
+                 classless_intf3_t *: classless_intf3,                  \
+                 classless_intf2_t *: classless_intf2,                  \
+                 classless_intf1_t *: classless_intf1,                  \
+                 default:                                               \
+                 _Generic((const __typeof(T) *)0,                       \
+                          classless_intf1_element_t *: classless_intf1, \
+                          classless_intf2_element_t *: classless_intf2, \
+                          classless_intf3_element_t *: classless_intf3, \
+                          classless_intf4_element_t *: classless_intf4, \
+                          classless_intf5_element_t *: classless_intf5, \
+                          classless_intf6_element_t *: classless_intf6, \
+                          classless_intf7_element_t *: classless_intf7, \
+                          classless_intf8_element_t *: classless_intf8, \
+                          classless_intf9_element_t *: classless_intf9, \
+                          classless_intf10_element_t *: classless_intf10, \
+                          classless_intf11_element_t *: classless_intf11, \
+                          classless_intf12_element_t *: classless_intf12, \
+                          default: (DEFAULT)))
+
+#undef CLS_INTF_FROM_INDEX
+#define CLS_INTF_FROM_INDEX(I, DEFAULT)                                 \
+        _Generic((const char(*)[(I)])0,                                 \
+                 const char(*)[1]: classless_intf1,                     \
+                 const char(*)[2]: classless_intf2,                     \
+                 const char(*)[3]: classless_intf3,                     \
+                 const char(*)[4]: classless_intf4,                     \
+                 const char(*)[5]: classless_intf5,                     \
+                 const char(*)[6]: classless_intf6,                     \
+                 const char(*)[7]: classless_intf7,                     \
+                 const char(*)[8]: classless_intf8,                     \
+                 const char(*)[9]: classless_intf9,                     \
+                 const char(*)[10]: classless_intf10,                   \
+                 const char(*)[11]: classless_intf11,                   \
+                 const char(*)[12]: classless_intf12,                   \
+                 default: (DEFAULT))
+
+#undef CLS_INTF_REGISTER
+#define CLS_INTF_REGISTER "classless_interface_clang/intf13.h"
+
+__attribute__((__unused__)) static const classless_intf12_t classless_intf12 = {
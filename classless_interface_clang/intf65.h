@@ -0,0 +1 @@
+#error "Too many interfaces: the registry only supports 64, see generate.py."
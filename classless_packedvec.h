@@ -0,0 +1,469 @@
+#pragma once
+/*
+ * A packedvec is an immutable, compressed, vector of uint32_t.
+ *
+ * Values are grouped in blocks of 128.  Each block stores its values
+ * as fixed-width offsets from a per-block base (frame of reference),
+ * with the narrowest width that fits the block's range.  Blocks of
+ * (mostly) increasing values may instead use delta coding: each value
+ * is stored as the difference with the value 4 positions earlier, and
+ * the first 4 as offsets from the block's base.  The encoder picks
+ * whichever coding is narrower for each block.
+ *
+ * The packing is "vertical": value k goes in lane k % 4, and each
+ * lane packs its 32 values in its own stream of 32-bit words,
+ * interleaved with the other lanes' streams.  A block of width w thus
+ * spans exactly 4w words, and decoding is the same sequence of shifts
+ * and masks for all 4 lanes, i.e., one 128-bit SIMD operation at a
+ * time.  The SIMD code uses GCC vector extensions, so it compiles to
+ * SSE2 on x86-64 and NEON on ARM without any intrinsics.
+ *
+ * Random access is O(1) for frame of reference blocks, and must sum
+ * up to 32 deltas in delta-coded blocks.  Scans should decode whole
+ * blocks instead.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "classless.h"
+#include "classless_buf.h"
+
+#define CLS_PACKEDVEC_BLOCK 128
+
+struct classless_packedvec_block {
+        size_t offset;  /* Index of the block's first word. */
+        uint32_t base;
+        uint8_t width;
+        bool delta;
+};
+
+struct classless_packedvec_header {
+        struct classless_packedvec_block *blocks;
+        size_t nblocks;
+        size_t nwords;
+        size_t size;
+};
+
+typedef uint32_t classless_packedvec_v4_ __attribute__((__vector_size__(16)));
+
+/*
+ * The pointer to the packed words is tagged with address space 104.
+ */
+CLS_TAG_REGISTER(classless_packedvec, 104);
+
+/*
+ * A packedvec is `uint32_t cls_packedvec *`, or `const uint32_t
+ * cls_packedvec *` when it's only meant to be read.
+ */
+#define cls_packedvec CLS_TAG(classless_packedvec)
+
+/*
+ * Allocates a packedvec with a compressed copy of the uint32_t values
+ * in `VIEW`.  Delta coding is only considered when DELTA is true.
+ *
+ * Returns NULL on allocation failure.
+ */
+#define cls_packedvec_encode(VIEW, DELTA)                               \
+        ({                                                              \
+                CLS_LET(cls_packedvec_src_, (VIEW));                    \
+                CLS_TAG_CHECK(classless_buf, cls_packedvec_src_);       \
+                _Static_assert(__builtin_types_compatible_p(            \
+                                       __typeof__(**cls_packedvec_src_), uint32_t), \
+                               "Packedvecs only store uint32_t.");      \
+                                                                        \
+                (uint32_t cls_packedvec *)classless_packedvec_encode_(  \
+                        cls_buf_data(cls_packedvec_src_),               \
+                        cls_buf_size(cls_packedvec_src_),               \
+                        (DELTA));                                       \
+        })
+
+/*
+ * Deallocates a packedvec.  Safe to call on NULL.
+ */
+#define cls_packedvec_destroy(PV)                                       \
+        ({                                                              \
+                CLS_LET(cls_packedvec_, (PV));                          \
+                CLS_MUTABLE_TAG_CHECK(classless_packedvec, cls_packedvec_); \
+                                                                        \
+                classless_packedvec_destroy_(CLS_TAG_STRIPPED(classless_packedvec, \
+                                                              cls_packedvec_)); \
+        })
+
+/*
+ * Returns the number of values in the packedvec.
+ */
+#define cls_packedvec_size(PV)                                          \
+        ({                                                              \
+                CLS_LET(cls_packedvec_, (PV));                          \
+                CLS_TAG_CHECK(classless_packedvec, cls_packedvec_);     \
+                                                                        \
+                (cls_packedvec_ == NULL)                                \
+                ? 0                                                     \
+                : CLS_HEADER_OF(classless_packedvec_header, cls_packedvec_)->size; \
+        })
+
+/*
+ * Returns the number of blocks in the packedvec.  All blocks but the
+ * last have exactly CLS_PACKEDVEC_BLOCK values.
+ */
+#define cls_packedvec_nblocks(PV)                                       \
+        ({                                                              \
+                CLS_LET(cls_packedvec_, (PV));                          \
+                CLS_TAG_CHECK(classless_packedvec, cls_packedvec_);     \
+                                                                        \
+                (cls_packedvec_ == NULL)                                \
+                ? 0                                                     \
+                : CLS_HEADER_OF(classless_packedvec_header, cls_packedvec_)->nblocks; \
+        })
+
+/*
+ * Returns the size of the packed data, in bytes, including block
+ * metadata.
+ */
+#define cls_packedvec_bytes(PV)                                         \
+        ({                                                              \
+                CLS_LET(cls_packedvec_, (PV));                          \
+                CLS_TAG_CHECK(classless_packedvec, cls_packedvec_);     \
+                CLS_LET_HEADER(classless_packedvec_header, cls_packedvec_h_, \
+                               cls_packedvec_);                         \
+                                                                        \
+                (cls_packedvec_ == NULL)                                \
+                ? 0                                                     \
+                : cls_packedvec_h_->nwords * sizeof(uint32_t)           \
+                  + cls_packedvec_h_->nblocks                           \
+                  * sizeof(struct classless_packedvec_block);           \
+        })
+
+/*
+ * Returns the i'th value in the packedvec.
+ *
+ * Performs bound checking when asserts are enabled.
+ */
+#define cls_packedvec_at(PV, I)                                         \
+        ({                                                              \
+                CLS_LET(cls_packedvec_, (PV));                          \
+                size_t cls_packedvec_i_ = (I);                          \
+                CLS_TAG_CHECK(classless_packedvec, cls_packedvec_);     \
+                                                                        \
+                classless_packedvec_at_(                                \
+                        CLS_TAG_CONST_STRIPPED(classless_packedvec, cls_packedvec_), \
+                        cls_packedvec_i_);                              \
+        })
+
+/*
+ * Attempts to decode the values in block BLOCK and append them to the
+ * mutable uint32_t buf `BUF`.
+ *
+ * Returns true on success, does nothing and returns false if the buf
+ * does not have room for the whole block.
+ */
+#define cls_packedvec_decode(PV, BLOCK, BUF)                            \
+        ({                                                              \
+                CLS_LET(cls_packedvec_, (PV));                          \
+                size_t cls_packedvec_block_ = (BLOCK);                  \
+                CLS_LET(cls_packedvec_dst_, (BUF));                     \
+                CLS_TAG_CHECK(classless_packedvec, cls_packedvec_);     \
+                CLS_MUTABLE_TAG_CHECK(classless_buf, cls_packedvec_dst_); \
+                const uint32_t *cls_packedvec_words_ =                  \
+                        CLS_TAG_CONST_STRIPPED(classless_packedvec, cls_packedvec_); \
+                size_t cls_packedvec_n_ = classless_packedvec_block_size_( \
+                        cls_packedvec_words_, cls_packedvec_block_);    \
+                uint32_t *cls_packedvec_out_ =                          \
+                        cls_buf_reserve(cls_packedvec_dst_, cls_packedvec_n_); \
+                                                                        \
+                (cls_packedvec_out_ != NULL)                            \
+                        && (classless_packedvec_decode_(cls_packedvec_words_, \
+                                                        cls_packedvec_block_, \
+                                                        cls_packedvec_out_), \
+                            cls_buf_commit(cls_packedvec_dst_, cls_packedvec_n_)); \
+        })
+
+static inline unsigned int
+classless_packedvec_width_(uint32_t x)
+{
+
+        return (x == 0) ? 0 : 32 - __builtin_clz(x);
+}
+
+/*
+ * Chooses the coding for the CLS_PACKEDVEC_BLOCK values in `values`.
+ */
+static inline void
+classless_packedvec_plan_(const uint32_t *values, bool delta,
+    struct classless_packedvec_block *block)
+{
+        uint32_t min = values[0];
+        uint32_t max = values[0];
+
+        for (size_t i = 1; i < CLS_PACKEDVEC_BLOCK; i++) {
+                min = (values[i] < min) ? values[i] : min;
+                max = (values[i] > max) ? values[i] : max;
+        }
+
+        block->base = min;
+        block->width = classless_packedvec_width_(max - min);
+        block->delta = false;
+
+        if (delta && block->width > 0) {
+                uint32_t first = values[0];
+                uint32_t acc = 0;
+
+                for (size_t i = 1; i < 4; i++)
+                        first = (values[i] < first) ? values[i] : first;
+
+                for (size_t i = 0; i < 4; i++)
+                        acc |= values[i] - first;
+                for (size_t i = 4; i < CLS_PACKEDVEC_BLOCK; i++)
+                        acc |= values[i] - values[i - 4];
+
+                if (classless_packedvec_width_(acc) < block->width) {
+                        block->base = first;
+                        block->width = classless_packedvec_width_(acc);
+                        block->delta = true;
+                }
+        }
+
+        return;
+}
+
+static inline void
+classless_packedvec_pack_(const uint32_t *values, const struct classless_packedvec_block *block,
+    uint32_t *words)
+{
+        unsigned int width = block->width;
+
+        memset(words, 0, 4 * width * sizeof(*words));
+        if (width == 0)
+                return;
+
+        for (size_t k = 0; k < CLS_PACKEDVEC_BLOCK; k++) {
+                size_t lane = k % 4;
+                size_t bit = (k / 4) * width;
+                uint32_t *dst = &words[4 * (bit / 32) + lane];
+                unsigned int shift = bit % 32;
+                uint32_t v;
+
+                if (!block->delta)
+                        v = values[k] - block->base;
+                else if (k < 4)
+                        v = values[k] - block->base;
+                else
+                        v = values[k] - values[k - 4];
+
+                dst[0] |= v << shift;
+                if (shift + width > 32)
+                        dst[4] |= v >> (32 - shift);
+        }
+
+        return;
+}
+
+/*
+ * Copies the (up to) CLS_PACKEDVEC_BLOCK values starting at `src` in
+ * `values`, and pads partial blocks by repeating the last 4 values:
+ * the padding never widens the block, with or without delta coding.
+ */
+static inline void
+classless_packedvec_fill_(const uint32_t *src, size_t n, uint32_t *values)
+{
+
+        if (n > CLS_PACKEDVEC_BLOCK)
+                n = CLS_PACKEDVEC_BLOCK;
+
+        memcpy(values, src, n * sizeof(*values));
+        for (size_t i = n; i < CLS_PACKEDVEC_BLOCK; i++)
+                values[i] = (i >= 4) ? values[i - 4] : values[0];
+        return;
+}
+
+static inline void *
+classless_packedvec_encode_(const uint32_t *src, size_t n, bool delta)
+{
+        uint32_t values[CLS_PACKEDVEC_BLOCK];
+        struct classless_packedvec_header *h;
+        struct classless_packedvec_block *blocks;
+        uint32_t *words;
+        size_t nblocks = n / CLS_PACKEDVEC_BLOCK + (n % CLS_PACKEDVEC_BLOCK != 0);
+        size_t nwords = 0;
+        size_t words_size;
+
+        for (size_t i = 0; i < nblocks; i++) {
+                struct classless_packedvec_block block;
+
+                classless_packedvec_fill_(&src[i * CLS_PACKEDVEC_BLOCK],
+                    n - i * CLS_PACKEDVEC_BLOCK, values);
+                classless_packedvec_plan_(values, delta, &block);
+                nwords += 4 * block.width;
+        }
+
+        /* Keep the block metadata aligned. */
+        words_size = (nwords * sizeof(uint32_t) + sizeof(size_t) - 1) & -sizeof(size_t);
+        h = malloc(sizeof(*h) + words_size + nblocks * sizeof(*blocks));
+        if (h == NULL)
+                return NULL;
+
+        words = (void *)(h + 1);
+        blocks = (void *)((char *)words + words_size);
+        h->blocks = blocks;
+        h->nblocks = nblocks;
+        h->nwords = nwords;
+        h->size = n;
+
+        nwords = 0;
+        for (size_t i = 0; i < nblocks; i++) {
+                classless_packedvec_fill_(&src[i * CLS_PACKEDVEC_BLOCK],
+                    n - i * CLS_PACKEDVEC_BLOCK, values);
+                classless_packedvec_plan_(values, delta, &blocks[i]);
+                blocks[i].offset = nwords;
+                classless_packedvec_pack_(values, &blocks[i], &words[nwords]);
+                nwords += 4 * blocks[i].width;
+        }
+
+        return words;
+}
+
+static inline void
+classless_packedvec_destroy_(void *words)
+{
+
+        if (words == NULL)
+                return;
+
+        free(CLS_HEADER_OF(classless_packedvec_header, words));
+        return;
+}
+
+static inline size_t
+classless_packedvec_block_size_(const uint32_t *words, size_t block)
+{
+        const struct classless_packedvec_header *h =
+                CLS_HEADER_OF(classless_packedvec_header, words);
+
+        assert(block < h->nblocks);
+        if (block >= h->nblocks)
+                return 0;
+
+        return (block + 1 < h->nblocks)
+                ? CLS_PACKEDVEC_BLOCK
+                : h->size - block * CLS_PACKEDVEC_BLOCK;
+}
+
+static inline uint32_t
+classless_packedvec_at_(const uint32_t *words, size_t i)
+{
+        const struct classless_packedvec_header *h =
+                CLS_HEADER_OF(classless_packedvec_header, words);
+        const struct classless_packedvec_block *block;
+        const uint32_t *lane;
+        unsigned int width;
+        uint32_t mask;
+        uint32_t acc;
+        size_t k;
+
+        assert(i < h->size);
+        block = &h->blocks[i / CLS_PACKEDVEC_BLOCK];
+        width = block->width;
+        if (width == 0)
+                return block->base;
+
+        k = i % CLS_PACKEDVEC_BLOCK;
+        lane = &words[block->offset + k % 4];
+        mask = (width == 32) ? UINT32_MAX : ((uint32_t)1 << width) - 1;
+        acc = block->base;
+        for (size_t j = block->delta ? 0 : k / 4; j <= k / 4; j++) {
+                size_t bit = j * width;
+                unsigned int shift = bit % 32;
+                uint32_t v;
+
+                v = lane[4 * (bit / 32)] >> shift;
+                if (shift + width > 32)
+                        v |= lane[4 * (bit / 32 + 1)] << (32 - shift);
+                acc += v & mask;
+        }
+
+        return acc;
+}
+
+static inline classless_packedvec_v4_
+classless_packedvec_load_(const uint32_t *src)
+{
+        classless_packedvec_v4_ ret;
+
+        memcpy(&ret, src, sizeof(ret));
+        return ret;
+}
+
+/*
+ * Decodes all CLS_PACKEDVEC_BLOCK values in `block` to `out`, 4 at a
+ * time: each iteration extracts one value from every lane.
+ */
+static inline void
+classless_packedvec_decode_full_(const uint32_t *words,
+    const struct classless_packedvec_block *block, uint32_t *out)
+{
+        const uint32_t *src = &words[block->offset];
+        const uint32_t *end = src + 4 * block->width;
+        unsigned int width = block->width;
+        classless_packedvec_v4_ acc = (classless_packedvec_v4_){ 0 } + block->base;
+        classless_packedvec_v4_ cur;
+        uint32_t mask;
+        unsigned int shift = 0;
+
+        if (width == 0) {
+                for (size_t j = 0; j < CLS_PACKEDVEC_BLOCK / 4; j++)
+                        memcpy(&out[4 * j], &acc, sizeof(acc));
+                return;
+        }
+
+        mask = (width == 32) ? UINT32_MAX : ((uint32_t)1 << width) - 1;
+        cur = classless_packedvec_load_(src);
+        for (size_t j = 0; j < CLS_PACKEDVEC_BLOCK / 4; j++) {
+                classless_packedvec_v4_ v = cur >> shift;
+
+                shift += width;
+                if (shift >= 32) {
+                        shift -= 32;
+                        src += 4;
+                        if (src < end)
+                                cur = classless_packedvec_load_(src);
+                        if (shift > 0)
+                                v |= cur << (width - shift);
+                }
+
+                v &= mask;
+                if (block->delta) {
+                        acc += v;
+                        v = acc;
+                } else {
+                        v += acc;
+                }
+
+                memcpy(&out[4 * j], &v, sizeof(v));
+        }
+
+        return;
+}
+
+static inline void
+classless_packedvec_decode_(const uint32_t *words, size_t block, uint32_t *out)
+{
+        const struct classless_packedvec_header *h =
+                CLS_HEADER_OF(classless_packedvec_header, words);
+        uint32_t values[CLS_PACKEDVEC_BLOCK];
+        size_t n;
+
+        n = classless_packedvec_block_size_(words, block);
+        if (n == CLS_PACKEDVEC_BLOCK) {
+                classless_packedvec_decode_full_(words, &h->blocks[block], out);
+                return;
+        }
+
+        classless_packedvec_decode_full_(words, &h->blocks[block], values);
+        memcpy(out, values, n * sizeof(*out));
+        return;
+}
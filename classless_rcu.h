@@ -0,0 +1,450 @@
+#pragma once
+/*
+ * A vec_rcu publishes a read-mostly vec to many reader threads, while
+ * a writer occasionally replaces it.
+ *
+ * Readers use quiescent-state-based reclamation (QSBR): each reader
+ * thread registers a `struct classless_vec_rcu_reader`, and snapshots
+ * of the published vec are valid until that reader next announces a
+ * quiescent state (or goes offline).  Taking a snapshot is a single
+ * load, and announcing a quiescent state reads the shared epoch and
+ * writes to the reader's own cache line, so readers never write to
+ * shared cache lines, and never execute atomic read-modify-writes.
+ *
+ * The writer builds a new vec and publishes it with one store.  The
+ * old vec is retired, and freed with `cls_vec_destroy` once every
+ * online reader has gone through a quiescent state.  Writers are
+ * serialised by a mutex, so this header requires pthreads.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "classless.h"
+#include "classless_vec.h"
+
+/*
+ * Readers' state, one per reader thread.  The struct fills a cache
+ * line, so that readers don't share lines when their states are
+ * adjacent in memory.
+ */
+struct classless_vec_rcu_reader {
+        /* The last epoch observed by the reader, 0 when offline. */
+        uint64_t epoch __attribute__((__aligned__(64)));
+        struct classless_vec_rcu_reader *next;
+};
+
+struct classless_vec_rcu_retired {
+        struct classless_vec_rcu_retired *next;
+        void *vec;
+        /* Readers that have observed this epoch can't see `vec`. */
+        uint64_t epoch;
+};
+
+struct classless_vec_rcu_header {
+        /* Read by readers and only written when publishing. */
+        void *current __attribute__((__aligned__(64)));
+        uint64_t epoch;
+
+        /* Writer-side state, protected by `lock`. */
+        pthread_mutex_t lock __attribute__((__aligned__(64)));
+        struct classless_vec_rcu_reader *readers;
+        struct classless_vec_rcu_retired *retired;
+};
+
+/*
+ * The handle is tagged with address space 105.
+ */
+CLS_TAG_REGISTER(classless_vec_rcu, 105);
+
+/*
+ * A vec_rcu that publishes `T cls_vec *` is `T cls_vec_rcu *`.
+ */
+#define cls_vec_rcu CLS_TAG(classless_vec_rcu)
+
+/*
+ * Allocates a vec_rcu of T that publishes the mutable vec `VEC`, or
+ * returns NULL on allocation failure.  To publish nothing, pass a
+ * typed `(T cls_vec *)NULL`: a bare NULL fails the tag check.
+ *
+ * On success, the vec_rcu owns `VEC`.
+ */
+#define cls_vec_rcu_create(T, VEC)                                      \
+        ({                                                              \
+                CLS_LET(cls_rcu_vec_, (VEC));                           \
+                CLS_MUTABLE_TAG_CHECK(classless_vec, cls_rcu_vec_);     \
+                                                                        \
+                (__typeof__(T) cls_vec_rcu *)classless_vec_rcu_create_( \
+                        CLS_TAG_STRIPPED(classless_vec, cls_rcu_vec_)); \
+        })
+
+/*
+ * Deallocates a vec_rcu, along with its published and retired vecs.
+ * Safe to call on NULL.
+ *
+ * There must not be any reader left.
+ */
+#define cls_vec_rcu_destroy(RCU)                                        \
+        ({                                                              \
+                CLS_LET(cls_rcu_, (RCU));                               \
+                CLS_MUTABLE_TAG_CHECK(classless_vec_rcu, cls_rcu_);     \
+                                                                        \
+                classless_vec_rcu_destroy_((cls_rcu_ == NULL)           \
+                    ? NULL                                              \
+                    : CLS_HEADER_OF(classless_vec_rcu_header, cls_rcu_)); \
+        })
+
+/*
+ * Registers the `struct classless_vec_rcu_reader *` `READER` with the
+ * vec_rcu.  The reader starts online.
+ */
+#define cls_vec_rcu_register(RCU, READER)                               \
+        ({                                                              \
+                CLS_LET(cls_rcu_, (RCU));                               \
+                CLS_TAG_CHECK(classless_vec_rcu, cls_rcu_);             \
+                                                                        \
+                classless_vec_rcu_register_(                            \
+                        CLS_HEADER_OF(classless_vec_rcu_header, cls_rcu_), \
+                        (READER));                                      \
+        })
+
+/*
+ * Removes `READER` from the vec_rcu's readers.  The reader's
+ * snapshots are invalid after this call.
+ */
+#define cls_vec_rcu_unregister(RCU, READER)                             \
+        ({                                                              \
+                CLS_LET(cls_rcu_, (RCU));                               \
+                CLS_TAG_CHECK(classless_vec_rcu, cls_rcu_);             \
+                                                                        \
+                classless_vec_rcu_unregister_(                          \
+                        CLS_HEADER_OF(classless_vec_rcu_header, cls_rcu_), \
+                        (READER));                                      \
+        })
+
+/*
+ * Returns a snapshot of the published vec, as a `const T cls_vec *`
+ * (NULL if nothing was published).
+ *
+ * The snapshot remains valid until the calling reader's next
+ * quiescent state, or until it goes offline.
+ */
+#define cls_vec_rcu_read(RCU)                                           \
+        ({                                                              \
+                CLS_LET(cls_rcu_, (RCU));                               \
+                CLS_TAG_CHECK(classless_vec_rcu, cls_rcu_);             \
+                                                                        \
+                (const CLS_TAG_POINTEE(cls_rcu_) cls_vec *)__atomic_load_n( \
+                        &CLS_HEADER_OF(classless_vec_rcu_header, cls_rcu_)->current, \
+                        __ATOMIC_ACQUIRE);                              \
+        })
+
+/*
+ * Announces that the online reader `READER` doesn't hold any snapshot
+ * anymore.  Readers should do so regularly, e.g., between requests:
+ * retired vecs can't be freed until all online readers have.
+ */
+#define cls_vec_rcu_quiescent(RCU, READER)                              \
+        ({                                                              \
+                CLS_LET(cls_rcu_, (RCU));                               \
+                CLS_TAG_CHECK(classless_vec_rcu, cls_rcu_);             \
+                                                                        \
+                classless_vec_rcu_quiescent_(                           \
+                        CLS_HEADER_OF(classless_vec_rcu_header, cls_rcu_), \
+                        (READER));                                      \
+        })
+
+/*
+ * Marks `READER` as offline: writers won't wait for it, and it must
+ * not take or use snapshots until it's back online.  Readers should
+ * go offline before blocking for a long time.
+ */
+#define cls_vec_rcu_offline(RCU, READER)                                \
+        ({                                                              \
+                CLS_LET(cls_rcu_, (RCU));                               \
+                CLS_TAG_CHECK(classless_vec_rcu, cls_rcu_);             \
+                                                                        \
+                (void)cls_rcu_;                                         \
+                __atomic_store_n(&(READER)->epoch, 0, __ATOMIC_RELEASE); \
+        })
+
+/*
+ * Marks the offline `READER` as online again.
+ */
+#define cls_vec_rcu_online(RCU, READER)                                 \
+        ({                                                              \
+                CLS_LET(cls_rcu_, (RCU));                               \
+                CLS_TAG_CHECK(classless_vec_rcu, cls_rcu_);             \
+                                                                        \
+                classless_vec_rcu_online_(                              \
+                        CLS_HEADER_OF(classless_vec_rcu_header, cls_rcu_), \
+                        (READER));                                      \
+        })
+
+/*
+ * Publishes the mutable vec `VEC`, and retires the previously
+ * published vec.  The vec_rcu owns `VEC` after the call.  To publish
+ * nothing, pass a typed `(T cls_vec *)NULL`: a bare NULL fails the tag
+ * check.
+ *
+ * Also frees the retired vecs that readers can't see anymore.  If it
+ * can't allocate the retired vec's bookkeeping, it synchronizes
+ * instead, so the calling thread must not be an online reader of the
+ * vec_rcu.
+ */
+#define cls_vec_rcu_publish(RCU, VEC)                                   \
+        ({                                                              \
+                CLS_LET(cls_rcu_, (RCU));                               \
+                CLS_LET(cls_rcu_vec_, (VEC));                           \
+                CLS_TAG_CHECK(classless_vec_rcu, cls_rcu_);             \
+                CLS_MUTABLE_TAG_CHECK(classless_vec, cls_rcu_vec_);     \
+                _Static_assert(__builtin_types_compatible_p(            \
+                                       CLS_TAG_POINTEE(cls_rcu_),       \
+                                       CLS_TAG_POINTEE(cls_rcu_vec_)),  \
+                               "Published vec must match the vec_rcu's type."); \
+                                                                        \
+                classless_vec_rcu_publish_(                             \
+                        CLS_HEADER_OF(classless_vec_rcu_header, cls_rcu_), \
+                        CLS_TAG_STRIPPED(classless_vec, cls_rcu_vec_)); \
+        })
+
+/*
+ * Frees the retired vecs that readers can't see anymore, without
+ * waiting.  Returns the number of vecs freed.
+ */
+#define cls_vec_rcu_reclaim(RCU)                                        \
+        ({                                                              \
+                CLS_LET(cls_rcu_, (RCU));                               \
+                CLS_TAG_CHECK(classless_vec_rcu, cls_rcu_);             \
+                                                                        \
+                classless_vec_rcu_reclaim_(                             \
+                        CLS_HEADER_OF(classless_vec_rcu_header, cls_rcu_), \
+                        false);                                         \
+        })
+
+/*
+ * Waits until every online reader has gone through a quiescent state,
+ * and frees all retired vecs.  Returns the number of vecs freed.
+ *
+ * The calling thread must not be an online reader of the vec_rcu.
+ */
+#define cls_vec_rcu_synchronize(RCU)                                    \
+        ({                                                              \
+                CLS_LET(cls_rcu_, (RCU));                               \
+                CLS_TAG_CHECK(classless_vec_rcu, cls_rcu_);             \
+                                                                        \
+                classless_vec_rcu_reclaim_(                             \
+                        CLS_HEADER_OF(classless_vec_rcu_header, cls_rcu_), \
+                        true);                                          \
+        })
+
+static inline void *
+classless_vec_rcu_create_(void *vec)
+{
+        struct classless_vec_rcu_header *h;
+
+        if (posix_memalign((void **)&h, 64, sizeof(*h)) != 0)
+                return NULL;
+
+        if (pthread_mutex_init(&h->lock, NULL) != 0) {
+                free(h);
+                return NULL;
+        }
+
+        h->current = vec;
+        h->epoch = 1;
+        h->readers = NULL;
+        h->retired = NULL;
+        return h + 1;
+}
+
+static inline void
+classless_vec_rcu_destroy_(struct classless_vec_rcu_header *h)
+{
+        struct classless_vec_rcu_retired *retired;
+
+        if (h == NULL)
+                return;
+
+        assert(h->readers == NULL && "vec_rcu destroyed with registered readers");
+        retired = h->retired;
+        while (retired != NULL) {
+                struct classless_vec_rcu_retired *next = retired->next;
+
+                classless_vec_destroy_(retired->vec);
+                free(retired);
+                retired = next;
+        }
+
+        classless_vec_destroy_(h->current);
+        pthread_mutex_destroy(&h->lock);
+        free(h);
+        return;
+}
+
+static inline void
+classless_vec_rcu_online_(struct classless_vec_rcu_header *h,
+    struct classless_vec_rcu_reader *reader)
+{
+
+        __atomic_store_n(&reader->epoch,
+            __atomic_load_n(&h->epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+        /*
+         * A writer that saw us offline may free anything it retired;
+         * make sure it sees us online before we load any snapshot.
+         */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        return;
+}
+
+static inline void
+classless_vec_rcu_quiescent_(struct classless_vec_rcu_header *h,
+    struct classless_vec_rcu_reader *reader)
+{
+
+        /*
+         * The release store orders our reads of older snapshots
+         * before the announcement, and the acquire load guarantees
+         * that, once we announce an epoch, we only load vecs that
+         * were published no earlier.  Writers wait for online
+         * readers, so there's no need for a full fence here.
+         */
+        __atomic_store_n(&reader->epoch,
+            __atomic_load_n(&h->epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+        return;
+}
+
+static inline void
+classless_vec_rcu_register_(struct classless_vec_rcu_header *h,
+    struct classless_vec_rcu_reader *reader)
+{
+
+        pthread_mutex_lock(&h->lock);
+        reader->next = h->readers;
+        classless_vec_rcu_online_(h, reader);
+        h->readers = reader;
+        pthread_mutex_unlock(&h->lock);
+        return;
+}
+
+static inline void
+classless_vec_rcu_unregister_(struct classless_vec_rcu_header *h,
+    struct classless_vec_rcu_reader *reader)
+{
+        struct classless_vec_rcu_reader **prev;
+
+        /*
+         * Go offline before taking the lock: a synchronizing writer
+         * waits for online readers with the lock held.
+         */
+        __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+        pthread_mutex_lock(&h->lock);
+        for (prev = &h->readers; *prev != NULL; prev = &(*prev)->next) {
+                if (*prev == reader) {
+                        *prev = reader->next;
+                        break;
+                }
+        }
+
+        pthread_mutex_unlock(&h->lock);
+        return;
+}
+
+/*
+ * Returns the oldest epoch observed by an online reader, or UINT64_MAX
+ * if all readers are offline.  If `wait` is true, first waits until
+ * all online readers have observed the current epoch.
+ *
+ * Must be called with the lock held.
+ */
+static inline uint64_t
+classless_vec_rcu_oldest_(struct classless_vec_rcu_header *h, bool wait)
+{
+        uint64_t oldest = UINT64_MAX;
+
+        /* Pairs with the fence in classless_vec_rcu_online_. */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        for (struct classless_vec_rcu_reader *reader = h->readers;
+             reader != NULL; reader = reader->next) {
+                uint64_t epoch = __atomic_load_n(&reader->epoch, __ATOMIC_ACQUIRE);
+
+                while (wait && epoch != 0 && epoch < h->epoch) {
+                        sched_yield();
+                        epoch = __atomic_load_n(&reader->epoch, __ATOMIC_ACQUIRE);
+                }
+
+                if (epoch != 0 && epoch < oldest)
+                        oldest = epoch;
+        }
+
+        return oldest;
+}
+
+static inline size_t
+classless_vec_rcu_reclaim_(struct classless_vec_rcu_header *h, bool wait)
+{
+        struct classless_vec_rcu_retired **prev;
+        uint64_t oldest;
+        size_t freed = 0;
+
+        pthread_mutex_lock(&h->lock);
+        oldest = classless_vec_rcu_oldest_(h, wait);
+        prev = &h->retired;
+        while (*prev != NULL) {
+                struct classless_vec_rcu_retired *retired = *prev;
+
+                if (retired->epoch > oldest) {
+                        prev = &retired->next;
+                        continue;
+                }
+
+                *prev = retired->next;
+                classless_vec_destroy_(retired->vec);
+                free(retired);
+                freed++;
+        }
+
+        pthread_mutex_unlock(&h->lock);
+        return freed;
+}
+
+static inline void
+classless_vec_rcu_publish_(struct classless_vec_rcu_header *h, void *vec)
+{
+        struct classless_vec_rcu_retired *retired;
+        void *old;
+
+        pthread_mutex_lock(&h->lock);
+        old = h->current;
+        __atomic_store_n(&h->current, vec, __ATOMIC_RELEASE);
+        /* Only writers update the epoch, so it needn't be an RMW. */
+        __atomic_store_n(&h->epoch, h->epoch + 1, __ATOMIC_RELEASE);
+
+        retired = (old == NULL) ? NULL : malloc(sizeof(*retired));
+        if (retired != NULL) {
+                retired->next = h->retired;
+                retired->vec = old;
+                retired->epoch = h->epoch;
+                h->retired = retired;
+        }
+
+        pthread_mutex_unlock(&h->lock);
+
+        /*
+         * If we couldn't allocate a retired node, wait for readers
+         * and free `old` directly.
+         */
+        if (old != NULL && retired == NULL) {
+                classless_vec_rcu_reclaim_(h, true);
+                classless_vec_destroy_(old);
+        } else {
+                classless_vec_rcu_reclaim_(h, false);
+        }
+
+        return;
+}
@@ -0,0 +1,609 @@
+#pragma once
+/*
+ * Reductions (sum, min, max, argmin, argmax, count) and byte
+ * histograms over buf views.
+ *
+ * Each reduction dispatches on the element type with `_Generic` to a
+ * kernel that reads the view's data directly, without per-element
+ * bounds checks, and keeps CLS_REDUCE_LANES independent accumulators
+ * so that the loop-carried dependency doesn't bound throughput (and
+ * so that the compiler can vectorise it).  When AVX2 is available,
+ * the `int` and `float` kernels are explicitly vectorised.
+ *
+ * Sums are widened: to `int64_t` for signed integers (with wraparound
+ * on overflow), to `uint64_t` for unsigned integers, and to `double`
+ * for floating-point types.  Floating-point sums are computed in an
+ * unspecified order.  NaNs are never the min or max of a view.
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#endif
+
+#include "classless.h"
+#include "classless_buf.h"
+
+#ifndef CLS_REDUCE_LANES
+# define CLS_REDUCE_LANES 8
+#endif
+
+/*
+ * Returns the sum of the elements in the view `VIEW`, widened as
+ * described above.
+ */
+#define cls_buf_sum(VIEW)                                               \
+        ({                                                              \
+                CLS_LET(cls_reduce_view_, (VIEW));                      \
+                CLS_TAG_CHECK(classless_buf, cls_reduce_view_);         \
+                                                                        \
+                CLS_REDUCE_DISPATCH_(sum, **cls_reduce_view_)(          \
+                        cls_buf_data(cls_reduce_view_),                 \
+                        cls_buf_size(cls_reduce_view_));                \
+        })
+
+/*
+ * Returns the smallest element in the view `VIEW`, or the largest
+ * value of the element type (infinity for floating-point types) if
+ * the view is empty.
+ */
+#define cls_buf_min(VIEW)                                               \
+        ({                                                              \
+                CLS_LET(cls_reduce_view_, (VIEW));                      \
+                CLS_TAG_CHECK(classless_buf, cls_reduce_view_);         \
+                                                                        \
+                CLS_REDUCE_DISPATCH_(min, **cls_reduce_view_)(          \
+                        cls_buf_data(cls_reduce_view_),                 \
+                        cls_buf_size(cls_reduce_view_));                \
+        })
+
+/*
+ * Returns the largest element in the view `VIEW`, or the smallest
+ * value of the element type (negative infinity for floating-point
+ * types) if the view is empty.
+ */
+#define cls_buf_max(VIEW)                                               \
+        ({                                                              \
+                CLS_LET(cls_reduce_view_, (VIEW));                      \
+                CLS_TAG_CHECK(classless_buf, cls_reduce_view_);         \
+                                                                        \
+                CLS_REDUCE_DISPATCH_(max, **cls_reduce_view_)(          \
+                        cls_buf_data(cls_reduce_view_),                 \
+                        cls_buf_size(cls_reduce_view_));                \
+        })
+
+/*
+ * Returns the index of the first smallest element in the view `VIEW`,
+ * or the size of the view if it's empty (or only contains NaNs).
+ *
+ * This makes two passes over the view, one to find the minimum and
+ * one to find its first occurrence: each pass vectorises, unlike a
+ * single pass that tracks the index of the running minimum.
+ */
+#define cls_buf_argmin(VIEW)                                            \
+        ({                                                              \
+                CLS_LET(cls_reduce_view_, (VIEW));                      \
+                CLS_TAG_CHECK(classless_buf, cls_reduce_view_);         \
+                                                                        \
+                CLS_REDUCE_DISPATCH_(find, **cls_reduce_view_)(         \
+                        cls_buf_data(cls_reduce_view_),                 \
+                        cls_buf_size(cls_reduce_view_),                 \
+                        CLS_REDUCE_DISPATCH_(min, **cls_reduce_view_)(  \
+                                cls_buf_data(cls_reduce_view_),         \
+                                cls_buf_size(cls_reduce_view_)));       \
+        })
+
+/*
+ * Returns the index of the first largest element in the view `VIEW`,
+ * or the size of the view if it's empty (or only contains NaNs).
+ */
+#define cls_buf_argmax(VIEW)                                            \
+        ({                                                              \
+                CLS_LET(cls_reduce_view_, (VIEW));                      \
+                CLS_TAG_CHECK(classless_buf, cls_reduce_view_);         \
+                                                                        \
+                CLS_REDUCE_DISPATCH_(find, **cls_reduce_view_)(         \
+                        cls_buf_data(cls_reduce_view_),                 \
+                        cls_buf_size(cls_reduce_view_),                 \
+                        CLS_REDUCE_DISPATCH_(max, **cls_reduce_view_)(  \
+                                cls_buf_data(cls_reduce_view_),         \
+                                cls_buf_size(cls_reduce_view_)));       \
+        })
+
+/*
+ * Returns the number of elements in the view `VIEW` that compare
+ * equal to `X`.
+ */
+#define cls_buf_count_eq(VIEW, X)                                       \
+        ({                                                              \
+                CLS_LET(cls_reduce_view_, (VIEW));                      \
+                CLS_TAG_CHECK(classless_buf, cls_reduce_view_);         \
+                                                                        \
+                CLS_REDUCE_DISPATCH_(count_eq, **cls_reduce_view_)(     \
+                        cls_buf_data(cls_reduce_view_),                 \
+                        cls_buf_size(cls_reduce_view_), (X));           \
+        })
+
+/*
+ * Adds the number of occurrences of each byte value `b` in the view
+ * `SRC` of 1-byte integers (e.g., `uint8_t`) to `COUNTS[b]`.
+ * `COUNTS` is a read-write view (or a buf) of integers.
+ *
+ * Returns true on success, does nothing and returns false if `COUNTS`
+ * has fewer than 256 elements.
+ */
+#define cls_buf_histogram(COUNTS, SRC)                                  \
+        ({                                                              \
+                CLS_LET(cls_reduce_counts_, (COUNTS));                  \
+                CLS_LET(cls_reduce_src_, (SRC));                        \
+                CLS_TAG_CHECK(classless_buf, cls_reduce_counts_);       \
+                CLS_TAG_CHECK(classless_buf, cls_reduce_src_);          \
+                _Static_assert(sizeof(**cls_reduce_src_) == 1           \
+                               && (__typeof__(**cls_reduce_src_))1 / 2 == 0, \
+                               "Histograms count byte values.");        \
+                bool cls_reduce_ok_ = cls_buf_size(cls_reduce_counts_) >= 256; \
+                                                                        \
+                if (cls_reduce_ok_) {                                   \
+                        __typeof__(**cls_reduce_counts_) *cls_reduce_dst_ = \
+                                cls_buf_data(cls_reduce_counts_);       \
+                        uint64_t cls_reduce_hist_[256];                 \
+                                                                        \
+                        classless_reduce_histogram_(cls_reduce_hist_,   \
+                            (const void *)cls_buf_data(cls_reduce_src_), \
+                            cls_buf_size(cls_reduce_src_));             \
+                        for (size_t cls_reduce_b_ = 0; cls_reduce_b_ < 256; \
+                             cls_reduce_b_++)                           \
+                                cls_reduce_dst_[cls_reduce_b_] +=       \
+                                        cls_reduce_hist_[cls_reduce_b_]; \
+                }                                                       \
+                                                                        \
+                cls_reduce_ok_;                                         \
+        })
+
+/*
+ * Selects the kernel for OP and the element type of X.  Unsupported
+ * element types fail to compile.
+ */
+#define CLS_REDUCE_DISPATCH_(OP, X)                                     \
+        _Generic((const __typeof__(X) *)0,                              \
+                 const char *: classless_reduce_##OP##_char_,           \
+                 const signed char *: classless_reduce_##OP##_schar_,   \
+                 const unsigned char *: classless_reduce_##OP##_uchar_, \
+                 const short *: classless_reduce_##OP##_short_,         \
+                 const unsigned short *: classless_reduce_##OP##_ushort_, \
+                 const int *: classless_reduce_##OP##_int_,             \
+                 const unsigned int *: classless_reduce_##OP##_uint_,   \
+                 const long *: classless_reduce_##OP##_long_,           \
+                 const unsigned long *: classless_reduce_##OP##_ulong_, \
+                 const long long *: classless_reduce_##OP##_llong_,     \
+                 const unsigned long long *: classless_reduce_##OP##_ullong_, \
+                 const float *: classless_reduce_##OP##_float_,         \
+                 const double *: classless_reduce_##OP##_double_)
+
+/*
+ * Defines the scalar kernels for element type T with suffix S: sums
+ * accumulate in ACC_T and return SUM_T, and LO and HI are the
+ * identities for max and min.
+ */
+#define CLS_REDUCE_KERNELS_(S, T, SUM_T, ACC_T, LO, HI)                 \
+        static inline SUM_T                                             \
+        classless_reduce_sum_##S##_(const T *x, size_t n)               \
+        {                                                               \
+                ACC_T acc[CLS_REDUCE_LANES] = { 0 };                    \
+                size_t i = 0;                                           \
+                                                                        \
+                for (; i + CLS_REDUCE_LANES <= n; i += CLS_REDUCE_LANES) { \
+                        for (size_t j = 0; j < CLS_REDUCE_LANES; j++)   \
+                                acc[j] += (ACC_T)x[i + j];              \
+                }                                                       \
+                                                                        \
+                for (; i < n; i++)                                      \
+                        acc[0] += (ACC_T)x[i];                          \
+                                                                        \
+                for (size_t j = 1; j < CLS_REDUCE_LANES; j++)           \
+                        acc[0] += acc[j];                               \
+                                                                        \
+                return (SUM_T)acc[0];                                   \
+        }                                                               \
+                                                                        \
+        static inline T                                                 \
+        classless_reduce_min_##S##_(const T *x, size_t n)               \
+        {                                                               \
+                T acc[CLS_REDUCE_LANES];                                \
+                size_t i = 0;                                           \
+                                                                        \
+                for (size_t j = 0; j < CLS_REDUCE_LANES; j++)           \
+                        acc[j] = (HI);                                  \
+                                                                        \
+                for (; i + CLS_REDUCE_LANES <= n; i += CLS_REDUCE_LANES) { \
+                        for (size_t j = 0; j < CLS_REDUCE_LANES; j++)   \
+                                acc[j] = (x[i + j] < acc[j]) ? x[i + j] : acc[j]; \
+                }                                                       \
+                                                                        \
+                for (; i < n; i++)                                      \
+                        acc[0] = (x[i] < acc[0]) ? x[i] : acc[0];       \
+                                                                        \
+                for (size_t j = 1; j < CLS_REDUCE_LANES; j++)           \
+                        acc[0] = (acc[j] < acc[0]) ? acc[j] : acc[0];   \
+                                                                        \
+                return acc[0];                                          \
+        }                                                               \
+                                                                        \
+        static inline T                                                 \
+        classless_reduce_max_##S##_(const T *x, size_t n)               \
+        {                                                               \
+                T acc[CLS_REDUCE_LANES];                                \
+                size_t i = 0;                                           \
+                                                                        \
+                for (size_t j = 0; j < CLS_REDUCE_LANES; j++)           \
+                        acc[j] = (LO);                                  \
+                                                                        \
+                for (; i + CLS_REDUCE_LANES <= n; i += CLS_REDUCE_LANES) { \
+                        for (size_t j = 0; j < CLS_REDUCE_LANES; j++)   \
+                                acc[j] = (x[i + j] > acc[j]) ? x[i + j] : acc[j]; \
+                }                                                       \
+                                                                        \
+                for (; i < n; i++)                                      \
+                        acc[0] = (x[i] > acc[0]) ? x[i] : acc[0];       \
+                                                                        \
+                for (size_t j = 1; j < CLS_REDUCE_LANES; j++)           \
+                        acc[0] = (acc[j] > acc[0]) ? acc[j] : acc[0];   \
+                                                                        \
+                return acc[0];                                          \
+        }                                                               \
+                                                                        \
+        static inline size_t                                            \
+        classless_reduce_count_eq_##S##_(const T *x, size_t n, T value) \
+        {                                                               \
+                size_t acc[CLS_REDUCE_LANES] = { 0 };                   \
+                size_t i = 0;                                           \
+                                                                        \
+                for (; i + CLS_REDUCE_LANES <= n; i += CLS_REDUCE_LANES) { \
+                        for (size_t j = 0; j < CLS_REDUCE_LANES; j++)   \
+                                acc[j] += (x[i + j] == value);          \
+                }                                                       \
+                                                                        \
+                for (; i < n; i++)                                      \
+                        acc[0] += (x[i] == value);                      \
+                                                                        \
+                for (size_t j = 1; j < CLS_REDUCE_LANES; j++)           \
+                        acc[0] += acc[j];                               \
+                                                                        \
+                return acc[0];                                          \
+        }                                                               \
+                                                                        \
+        static inline size_t                                            \
+        classless_reduce_find_##S##_(const T *x, size_t n, T value)     \
+        {                                                               \
+                size_t i = 0;                                           \
+                                                                        \
+                /* Only branch once per block of lanes. */              \
+                for (; i + CLS_REDUCE_LANES <= n; i += CLS_REDUCE_LANES) { \
+                        bool hit = false;                               \
+                                                                        \
+                        for (size_t j = 0; j < CLS_REDUCE_LANES; j++)   \
+                                hit |= (x[i + j] == value);             \
+                        if (hit)                                        \
+                                break;                                  \
+                }                                                       \
+                                                                        \
+                for (; i < n; i++) {                                    \
+                        if (x[i] == value)                              \
+                                return i;                               \
+                }                                                       \
+                                                                        \
+                return n;                                               \
+        }
+
+#if CHAR_MIN < 0
+CLS_REDUCE_KERNELS_(char, char, int64_t, uint64_t, CHAR_MIN, CHAR_MAX)
+#else
+CLS_REDUCE_KERNELS_(char, char, uint64_t, uint64_t, CHAR_MIN, CHAR_MAX)
+#endif
+CLS_REDUCE_KERNELS_(schar, signed char, int64_t, uint64_t, SCHAR_MIN, SCHAR_MAX)
+CLS_REDUCE_KERNELS_(uchar, unsigned char, uint64_t, uint64_t, 0, UCHAR_MAX)
+CLS_REDUCE_KERNELS_(short, short, int64_t, uint64_t, SHRT_MIN, SHRT_MAX)
+CLS_REDUCE_KERNELS_(ushort, unsigned short, uint64_t, uint64_t, 0, USHRT_MAX)
+CLS_REDUCE_KERNELS_(int_scalar, int, int64_t, uint64_t, INT_MIN, INT_MAX)
+CLS_REDUCE_KERNELS_(uint, unsigned int, uint64_t, uint64_t, 0, UINT_MAX)
+CLS_REDUCE_KERNELS_(long, long, int64_t, uint64_t, LONG_MIN, LONG_MAX)
+CLS_REDUCE_KERNELS_(ulong, unsigned long, uint64_t, uint64_t, 0, ULONG_MAX)
+CLS_REDUCE_KERNELS_(llong, long long, int64_t, uint64_t, LLONG_MIN, LLONG_MAX)
+CLS_REDUCE_KERNELS_(ullong, unsigned long long, uint64_t, uint64_t, 0, ULLONG_MAX)
+CLS_REDUCE_KERNELS_(float_scalar, float, double, double, -HUGE_VALF, HUGE_VALF)
+CLS_REDUCE_KERNELS_(double, double, double, double, -HUGE_VAL, HUGE_VAL)
+
+/*
+ * The `int` and `float` kernels process 16 elements per iteration with
+ * AVX2, in two (four for widened sums) vector accumulators, and finish
+ * with the scalar kernels.
+ */
+static inline int64_t
+classless_reduce_sum_int_(const int *x, size_t n)
+{
+        size_t i = 0;
+        uint64_t sum = 0;
+
+#if defined(__AVX2__)
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        uint64_t lanes[4];
+
+        for (; i + 16 <= n; i += 16) {
+                acc0 = _mm256_add_epi64(acc0,
+                    _mm256_cvtepi32_epi64(_mm_loadu_si128((const void *)&x[i])));
+                acc1 = _mm256_add_epi64(acc1,
+                    _mm256_cvtepi32_epi64(_mm_loadu_si128((const void *)&x[i + 4])));
+                acc0 = _mm256_add_epi64(acc0,
+                    _mm256_cvtepi32_epi64(_mm_loadu_si128((const void *)&x[i + 8])));
+                acc1 = _mm256_add_epi64(acc1,
+                    _mm256_cvtepi32_epi64(_mm_loadu_si128((const void *)&x[i + 12])));
+        }
+
+        _mm256_storeu_si256((void *)lanes, _mm256_add_epi64(acc0, acc1));
+        sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+        return (int64_t)(sum + (uint64_t)classless_reduce_sum_int_scalar_(&x[i], n - i));
+}
+
+static inline int
+classless_reduce_min_int_(const int *x, size_t n)
+{
+        size_t i = 0;
+        int min = INT_MAX;
+
+#if defined(__AVX2__)
+        __m256i acc0 = _mm256_set1_epi32(INT_MAX);
+        __m256i acc1 = acc0;
+        int lanes[8];
+
+        for (; i + 16 <= n; i += 16) {
+                acc0 = _mm256_min_epi32(acc0, _mm256_loadu_si256((const void *)&x[i]));
+                acc1 = _mm256_min_epi32(acc1, _mm256_loadu_si256((const void *)&x[i + 8]));
+        }
+
+        _mm256_storeu_si256((void *)lanes, _mm256_min_epi32(acc0, acc1));
+        min = classless_reduce_min_int_scalar_(lanes, 8);
+#endif
+
+        int rest = classless_reduce_min_int_scalar_(&x[i], n - i);
+
+        return (rest < min) ? rest : min;
+}
+
+static inline int
+classless_reduce_max_int_(const int *x, size_t n)
+{
+        size_t i = 0;
+        int max = INT_MIN;
+
+#if defined(__AVX2__)
+        __m256i acc0 = _mm256_set1_epi32(INT_MIN);
+        __m256i acc1 = acc0;
+        int lanes[8];
+
+        for (; i + 16 <= n; i += 16) {
+                acc0 = _mm256_max_epi32(acc0, _mm256_loadu_si256((const void *)&x[i]));
+                acc1 = _mm256_max_epi32(acc1, _mm256_loadu_si256((const void *)&x[i + 8]));
+        }
+
+        _mm256_storeu_si256((void *)lanes, _mm256_max_epi32(acc0, acc1));
+        max = classless_reduce_max_int_scalar_(lanes, 8);
+#endif
+
+        int rest = classless_reduce_max_int_scalar_(&x[i], n - i);
+
+        return (rest > max) ? rest : max;
+}
+
+static inline size_t
+classless_reduce_count_eq_int_(const int *x, size_t n, int value)
+{
+        size_t i = 0;
+        size_t count = 0;
+
+#if defined(__AVX2__)
+        __m256i needle = _mm256_set1_epi32(value);
+
+        /* Flush the 32-bit lane counters before they can overflow. */
+        while (i + 16 <= n) {
+                size_t stop = (n - i > ((size_t)1 << 31)) ? i + ((size_t)1 << 31) : n;
+                __m256i acc0 = _mm256_setzero_si256();
+                __m256i acc1 = _mm256_setzero_si256();
+                uint32_t lanes[8];
+
+                for (; i + 16 <= stop; i += 16) {
+                        __m256i v0 = _mm256_loadu_si256((const void *)&x[i]);
+                        __m256i v1 = _mm256_loadu_si256((const void *)&x[i + 8]);
+
+                        acc0 = _mm256_sub_epi32(acc0, _mm256_cmpeq_epi32(v0, needle));
+                        acc1 = _mm256_sub_epi32(acc1, _mm256_cmpeq_epi32(v1, needle));
+                }
+
+                _mm256_storeu_si256((void *)lanes, _mm256_add_epi32(acc0, acc1));
+                for (size_t j = 0; j < 8; j++)
+                        count += lanes[j];
+        }
+#endif
+
+        return count + classless_reduce_count_eq_int_scalar_(&x[i], n - i, value);
+}
+
+static inline size_t
+classless_reduce_find_int_(const int *x, size_t n, int value)
+{
+
+        return classless_reduce_find_int_scalar_(x, n, value);
+}
+
+static inline double
+classless_reduce_sum_float_(const float *x, size_t n)
+{
+        size_t i = 0;
+        double sum = 0;
+
+#if defined(__AVX2__)
+        __m256d acc0 = _mm256_setzero_pd();
+        __m256d acc1 = _mm256_setzero_pd();
+        __m256d acc2 = _mm256_setzero_pd();
+        __m256d acc3 = _mm256_setzero_pd();
+        double lanes[4];
+
+        for (; i + 16 <= n; i += 16) {
+                acc0 = _mm256_add_pd(acc0, _mm256_cvtps_pd(_mm_loadu_ps(&x[i])));
+                acc1 = _mm256_add_pd(acc1, _mm256_cvtps_pd(_mm_loadu_ps(&x[i + 4])));
+                acc2 = _mm256_add_pd(acc2, _mm256_cvtps_pd(_mm_loadu_ps(&x[i + 8])));
+                acc3 = _mm256_add_pd(acc3, _mm256_cvtps_pd(_mm_loadu_ps(&x[i + 12])));
+        }
+
+        _mm256_storeu_pd(lanes,
+            _mm256_add_pd(_mm256_add_pd(acc0, acc1), _mm256_add_pd(acc2, acc3)));
+        sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+        return sum + classless_reduce_sum_float_scalar_(&x[i], n - i);
+}
+
+/*
+ * `_mm256_min_ps(a, b)` returns b when either is NaN, so the
+ * accumulator goes second to skip NaNs like the scalar kernels.
+ */
+static inline float
+classless_reduce_min_float_(const float *x, size_t n)
+{
+        size_t i = 0;
+        float min = HUGE_VALF;
+
+#if defined(__AVX2__)
+        __m256 acc0 = _mm256_set1_ps(HUGE_VALF);
+        __m256 acc1 = acc0;
+        float lanes[8];
+
+        for (; i + 16 <= n; i += 16) {
+                acc0 = _mm256_min_ps(_mm256_loadu_ps(&x[i]), acc0);
+                acc1 = _mm256_min_ps(_mm256_loadu_ps(&x[i + 8]), acc1);
+        }
+
+        _mm256_storeu_ps(lanes, _mm256_min_ps(acc0, acc1));
+        min = classless_reduce_min_float_scalar_(lanes, 8);
+#endif
+
+        float rest = classless_reduce_min_float_scalar_(&x[i], n - i);
+
+        return (rest < min) ? rest : min;
+}
+
+static inline float
+classless_reduce_max_float_(const float *x, size_t n)
+{
+        size_t i = 0;
+        float max = -HUGE_VALF;
+
+#if defined(__AVX2__)
+        __m256 acc0 = _mm256_set1_ps(-HUGE_VALF);
+        __m256 acc1 = acc0;
+        float lanes[8];
+
+        for (; i + 16 <= n; i += 16) {
+                acc0 = _mm256_max_ps(_mm256_loadu_ps(&x[i]), acc0);
+                acc1 = _mm256_max_ps(_mm256_loadu_ps(&x[i + 8]), acc1);
+        }
+
+        _mm256_storeu_ps(lanes, _mm256_max_ps(acc0, acc1));
+        max = classless_reduce_max_float_scalar_(lanes, 8);
+#endif
+
+        float rest = classless_reduce_max_float_scalar_(&x[i], n - i);
+
+        return (rest > max) ? rest : max;
+}
+
+static inline size_t
+classless_reduce_count_eq_float_(const float *x, size_t n, float value)
+{
+        size_t i = 0;
+        size_t count = 0;
+
+#if defined(__AVX2__)
+        __m256 needle = _mm256_set1_ps(value);
+
+        while (i + 16 <= n) {
+                size_t stop = (n - i > ((size_t)1 << 31)) ? i + ((size_t)1 << 31) : n;
+                __m256i acc0 = _mm256_setzero_si256();
+                __m256i acc1 = _mm256_setzero_si256();
+                uint32_t lanes[8];
+
+                for (; i + 16 <= stop; i += 16) {
+                        __m256 eq0 = _mm256_cmp_ps(_mm256_loadu_ps(&x[i]), needle, _CMP_EQ_OQ);
+                        __m256 eq1 = _mm256_cmp_ps(_mm256_loadu_ps(&x[i + 8]), needle, _CMP_EQ_OQ);
+
+                        acc0 = _mm256_sub_epi32(acc0, _mm256_castps_si256(eq0));
+                        acc1 = _mm256_sub_epi32(acc1, _mm256_castps_si256(eq1));
+                }
+
+                _mm256_storeu_si256((void *)lanes, _mm256_add_epi32(acc0, acc1));
+                for (size_t j = 0; j < 8; j++)
+                        count += lanes[j];
+        }
+#endif
+
+        return count + classless_reduce_count_eq_float_scalar_(&x[i], n - i, value);
+}
+
+static inline size_t
+classless_reduce_find_float_(const float *x, size_t n, float value)
+{
+
+        return classless_reduce_find_float_scalar_(x, n, value);
+}
+
+/*
+ * Counts byte values in four interleaved sub-histograms, so that runs
+ * of equal bytes increment different counters instead of serialising
+ * on a store-to-load dependency through the same one.  The 32-bit
+ * counters are flushed to `counts` every 2^30 bytes.
+ */
+static inline void
+classless_reduce_histogram_(uint64_t counts[256], const uint8_t *x, size_t n)
+{
+        uint32_t sub[4][256];
+
+        memset(counts, 0, 256 * sizeof(counts[0]));
+        while (n > 0) {
+                size_t m = (n > ((size_t)1 << 30)) ? ((size_t)1 << 30) : n;
+                size_t i = 0;
+
+                memset(sub, 0, sizeof(sub));
+                for (; i + 8 <= m; i += 8) {
+                        uint64_t word;
+
+                        memcpy(&word, &x[i], sizeof(word));
+                        sub[0][word & 0xff]++;
+                        sub[1][(word >> 8) & 0xff]++;
+                        sub[2][(word >> 16) & 0xff]++;
+                        sub[3][(word >> 24) & 0xff]++;
+                        sub[0][(word >> 32) & 0xff]++;
+                        sub[1][(word >> 40) & 0xff]++;
+                        sub[2][(word >> 48) & 0xff]++;
+                        sub[3][word >> 56]++;
+                }
+
+                for (; i < m; i++)
+                        sub[0][x[i]]++;
+
+                for (size_t b = 0; b < 256; b++)
+                        counts[b] += (uint64_t)sub[0][b] + sub[1][b] + sub[2][b] + sub[3][b];
+
+                x += m;
+                n -= m;
+        }
+
+        return;
+}
@@ -0,0 +1,417 @@
+#pragma once
+/*
+ * A strvec is a fixed-capacity vector of variable-length byte
+ * strings.  All the bytes live in a single arena (a vec of char), and
+ * the strvec itself is an array of offsets into that arena: string i
+ * spans `[offsets[i - 1], offsets[i])`, with an implicit 0 for
+ * `offsets[-1]`.  Filling a strvec thus costs two allocations total,
+ * regardless of the number of strings.
+ *
+ * The offset type is the strvec's element type, and must be uint32_t
+ * or uint64_t: 32-bit offsets halve the index's footprint, but limit
+ * the arena to 4 GB.
+ *
+ * Strvecs may optionally store the first 8 bytes of each string in a
+ * big-endian uint64_t, in a side array allocated with the offsets.
+ * Comparing these prefixes as integers is equivalent to comparing the
+ * zero-padded strings' first 8 bytes, so most comparisons never touch
+ * the arena.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "classless.h"
+#include "classless_buf.h"
+#include "classless_vec.h"
+
+struct classless_strvec_header {
+        char cls_vec *bytes;
+        uint64_t *prefixes;
+        size_t capacity;
+        size_t size;
+};
+
+/*
+ * The pointer to the offset array is tagged with address space 103.
+ */
+CLS_TAG_REGISTER(classless_strvec, 103);
+
+/*
+ * A strvec is `uint32_t cls_strvec *` or `uint64_t cls_strvec *`.
+ */
+#define cls_strvec CLS_TAG(classless_strvec)
+
+/*
+ * Allocates a strvec with room for CAPACITY strings and BYTES bytes
+ * of string data, with offsets of type OFFSET_T.  If PREFIX is true,
+ * the strvec also stores inline prefixes.
+ *
+ * Returns NULL on allocation failure.
+ */
+#define cls_strvec_create(OFFSET_T, CAPACITY, BYTES, PREFIX)            \
+        ({                                                              \
+                _Static_assert(CLS_STRVEC_OFFSET_OK_(OFFSET_T),         \
+                               "Strvec offsets must be uint32_t or uint64_t."); \
+                                                                        \
+                (OFFSET_T cls_strvec *)classless_strvec_create_(        \
+                        (CAPACITY), sizeof(OFFSET_T), (BYTES), (PREFIX)); \
+        })
+
+#define CLS_STRVEC_OFFSET_OK_(OFFSET_T)                                 \
+        (__builtin_types_compatible_p(OFFSET_T, uint32_t)               \
+         || __builtin_types_compatible_p(OFFSET_T, uint64_t))
+
+/*
+ * Deallocates a strvec and its arena.  Safe to call on NULL.
+ */
+#define cls_strvec_destroy(STRVEC)                                      \
+        ({                                                              \
+                CLS_LET(cls_strvec_, (STRVEC));                         \
+                CLS_MUTABLE_TAG_CHECK(classless_strvec, cls_strvec_);   \
+                                                                        \
+                classless_strvec_destroy_(CLS_TAG_STRIPPED(classless_strvec, cls_strvec_)); \
+        })
+
+/*
+ * Returns the number of strings in the strvec.
+ */
+#define cls_strvec_size(STRVEC)                                         \
+        ({                                                              \
+                CLS_LET(cls_strvec_, (STRVEC));                         \
+                CLS_TAG_CHECK(classless_strvec, cls_strvec_);           \
+                                                                        \
+                (cls_strvec_ == NULL)                                   \
+                ? 0                                                     \
+                : CLS_HEADER_OF(classless_strvec_header, cls_strvec_)->size; \
+        })
+
+/*
+ * Returns the maximum number of strings in the strvec.
+ */
+#define cls_strvec_capacity(STRVEC)                                     \
+        ({                                                              \
+                CLS_LET(cls_strvec_, (STRVEC));                         \
+                CLS_TAG_CHECK(classless_strvec, cls_strvec_);           \
+                                                                        \
+                (cls_strvec_ == NULL)                                   \
+                ? 0                                                     \
+                : CLS_HEADER_OF(classless_strvec_header, cls_strvec_)->capacity; \
+        })
+
+/*
+ * Returns the number of bytes used in the strvec's arena.
+ */
+#define cls_strvec_bytes(STRVEC)                                        \
+        ({                                                              \
+                CLS_LET(cls_strvec_, (STRVEC));                         \
+                CLS_TAG_CHECK(classless_strvec, cls_strvec_);           \
+                                                                        \
+                (cls_strvec_ == NULL)                                   \
+                ? 0                                                     \
+                : cls_vec_size(CLS_HEADER_OF(classless_strvec_header,   \
+                                             cls_strvec_)->bytes);      \
+        })
+
+/*
+ * Returns a const view of the bytes in the i'th string.
+ *
+ * Asserts that the index is in range when asserts are enabled, and
+ * otherwise returns an empty view.
+ *
+ * Like `cls_buf_const_view`, the result must be used directly as a
+ * function argument; STRVEC and I are evaluated more than once.
+ */
+#define cls_strvec_at(STRVEC, I) cls_buf_const_view(CLS_STRVEC_AT_((STRVEC), (I)))
+
+/*
+ * The block must be a compound literal in the caller's scope: one in
+ * a statement expression would not outlive the expression.
+ */
+#define CLS_STRVEC_AT_(STRVEC, I)                                       \
+        cls_buf_block(&cls_vec_data(CLS_HEADER_OF(classless_strvec_header, (STRVEC))->bytes)[ \
+                              CLS_STRVEC_BOUND_((STRVEC), (I), false)], \
+                      NULL,                                             \
+                      CLS_STRVEC_BOUND_((STRVEC), (I), true)            \
+                      - CLS_STRVEC_BOUND_((STRVEC), (I), false),        \
+                      CLS_STRVEC_BOUND_((STRVEC), (I), true)            \
+                      - CLS_STRVEC_BOUND_((STRVEC), (I), false))
+
+#define CLS_STRVEC_BOUND_(STRVEC, I, END)                               \
+        classless_strvec_bound_(                                        \
+                CLS_HEADER_OF(classless_strvec_header, (STRVEC)),       \
+                CLS_TAG_CONST_STRIPPED(classless_strvec, (STRVEC)),     \
+                sizeof(*(STRVEC)), (I), (END))
+
+/*
+ * Attempts to append a copy of the bytes in `VIEW` as a new string.
+ *
+ * Returns true on success, false if the strvec or its arena is full,
+ * or if the new string would end past the largest offset value.
+ */
+#define cls_strvec_append(STRVEC, VIEW)                                 \
+        ({                                                              \
+                CLS_LET(cls_strvec_, (STRVEC));                         \
+                CLS_LET(cls_strvec_src_, (VIEW));                       \
+                CLS_MUTABLE_TAG_CHECK(classless_strvec, cls_strvec_);   \
+                CLS_TAG_CHECK(classless_buf, cls_strvec_src_);          \
+                _Static_assert(sizeof(**cls_strvec_src_) == 1,          \
+                               "Strvecs store byte strings.");          \
+                CLS_LET_STRIPPED(classless_strvec, cls_strvec_ptr_, cls_strvec_); \
+                                                                        \
+                classless_strvec_append_(cls_strvec_ptr_, sizeof(*cls_strvec_ptr_), \
+                                         cls_buf_data(cls_strvec_src_), \
+                                         cls_buf_size(cls_strvec_src_)); \
+        })
+
+/*
+ * Appends each DELIM-terminated record in `VIEW` (without its
+ * delimiter) as a new string, until the view or the strvec is
+ * exhausted.  A trailing unterminated record is left alone: it's
+ * usually the beginning of a record that continues in the next chunk
+ * of input.
+ *
+ * Returns the number of bytes consumed from the view, i.e., the
+ * offset right after the last appended record's delimiter.
+ */
+#define cls_strvec_append_delimited(STRVEC, VIEW, DELIM)                \
+        ({                                                              \
+                CLS_LET(cls_strvec_, (STRVEC));                         \
+                CLS_LET(cls_strvec_src_, (VIEW));                       \
+                CLS_MUTABLE_TAG_CHECK(classless_strvec, cls_strvec_);   \
+                CLS_TAG_CHECK(classless_buf, cls_strvec_src_);          \
+                _Static_assert(sizeof(**cls_strvec_src_) == 1,          \
+                               "Strvecs store byte strings.");          \
+                CLS_LET_STRIPPED(classless_strvec, cls_strvec_ptr_, cls_strvec_); \
+                                                                        \
+                classless_strvec_append_delimited_(                     \
+                        cls_strvec_ptr_, sizeof(*cls_strvec_ptr_),      \
+                        cls_buf_data(cls_strvec_src_),                  \
+                        cls_buf_size(cls_strvec_src_),                  \
+                        (DELIM));                                       \
+        })
+
+/*
+ * Returns the first 8 bytes of the i'th string, zero-padded, as a
+ * big-endian integer.  Only available if the strvec was created with
+ * inline prefixes.
+ */
+#define cls_strvec_prefix(STRVEC, I)                                    \
+        ({                                                              \
+                CLS_LET(cls_strvec_, (STRVEC));                         \
+                size_t cls_strvec_i_ = (I);                             \
+                CLS_TAG_CHECK(classless_strvec, cls_strvec_);           \
+                CLS_LET_HEADER(classless_strvec_header, cls_strvec_h_, cls_strvec_); \
+                                                                        \
+                assert(cls_strvec_h_->prefixes != NULL);                \
+                assert(cls_strvec_i_ < cls_strvec_h_->size);            \
+                cls_strvec_h_->prefixes[cls_strvec_i_];                 \
+        })
+
+/*
+ * Lexicographically compares the i'th and j'th strings, like memcmp
+ * with a shorter string less than any longer string it prefixes.
+ *
+ * Returns a negative, zero or positive value when the i'th string is
+ * less than, equal to, or greater than the j'th string.  Uses the
+ * inline prefixes, when available, to avoid reading the arena.
+ */
+#define cls_strvec_compare(STRVEC, I, J)                                \
+        ({                                                              \
+                CLS_LET(cls_strvec_, (STRVEC));                         \
+                CLS_TAG_CHECK(classless_strvec, cls_strvec_);           \
+                CLS_LET_STRIPPED(classless_strvec, cls_strvec_ptr_, cls_strvec_); \
+                                                                        \
+                classless_strvec_compare_(cls_strvec_ptr_, sizeof(*cls_strvec_ptr_), \
+                                          (I), (J));                    \
+        })
+
+static inline void *
+classless_strvec_create_(size_t capacity, size_t offset_size, size_t bytes, bool prefix)
+{
+        struct classless_strvec_header *h;
+        char cls_vec *arena;
+        size_t offsets_size;
+        size_t total;
+
+        if (__builtin_mul_overflow(capacity, offset_size, &offsets_size) ||
+            __builtin_add_overflow(offsets_size, sizeof(uint64_t) - 1, &offsets_size))
+                return NULL;
+
+        offsets_size &= -sizeof(uint64_t);
+        if (__builtin_mul_overflow(capacity, prefix ? sizeof(uint64_t) : 0, &total) ||
+            __builtin_add_overflow(total, offsets_size + sizeof(*h), &total))
+                return NULL;
+
+        arena = cls_vec_create(char, bytes);
+        if (arena == NULL)
+                return NULL;
+
+        h = malloc(total);
+        if (h == NULL) {
+                cls_vec_destroy(arena);
+                return NULL;
+        }
+
+        h->bytes = arena;
+        h->prefixes = prefix ? (void *)((char *)(h + 1) + offsets_size) : NULL;
+        h->capacity = capacity;
+        h->size = 0;
+        return h + 1;
+}
+
+static inline void
+classless_strvec_destroy_(void *offsets)
+{
+        struct classless_strvec_header *h;
+
+        if (offsets == NULL)
+                return;
+
+        h = CLS_HEADER_OF(classless_strvec_header, offsets);
+        cls_vec_destroy(h->bytes);
+        free(h);
+        return;
+}
+
+/*
+ * Returns the offset at which the i'th string begins, i.e., where the
+ * (i - 1)th ends.
+ */
+static inline size_t
+classless_strvec_offset_(const void *offsets, size_t offset_size, size_t i)
+{
+
+        if (i == 0)
+                return 0;
+
+        if (offset_size == sizeof(uint32_t))
+                return ((const uint32_t *)offsets)[i - 1];
+        return ((const uint64_t *)offsets)[i - 1];
+}
+
+/*
+ * Returns the arena offset where the i'th string begins (or ends, if
+ * `end`).  Out-of-range strings are empty, at the end of the arena.
+ */
+static inline size_t
+classless_strvec_bound_(const struct classless_strvec_header *h,
+    const void *offsets, size_t offset_size, size_t i, bool end)
+{
+
+        assert(i < h->size);
+        if (i >= h->size)
+                i = h->size;
+        else if (end)
+                i++;
+
+        return classless_strvec_offset_(offsets, offset_size, i);
+}
+
+static inline uint64_t
+classless_strvec_prefix_of_(const void *data, size_t len)
+{
+        uint64_t ret = 0;
+
+        memcpy(&ret, data, (len < sizeof(ret)) ? len : sizeof(ret));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        ret = __builtin_bswap64(ret);
+#endif
+        return ret;
+}
+
+static inline bool
+classless_strvec_append_(void *offsets, size_t offset_size, const void *src, size_t len)
+{
+        struct classless_strvec_header *h;
+        size_t begin;
+        size_t end;
+        char *dst;
+
+        h = CLS_HEADER_OF(classless_strvec_header, offsets);
+        if (h->size >= h->capacity)
+                return false;
+
+        begin = classless_strvec_offset_(offsets, offset_size, h->size);
+        if (__builtin_add_overflow(begin, len, &end) ||
+            (offset_size == sizeof(uint32_t) && end > UINT32_MAX))
+                return false;
+
+        dst = cls_vec_reserve(h->bytes, len);
+        if (dst == NULL)
+                return false;
+
+        memcpy(dst, src, len);
+        cls_vec_commit(h->bytes, len);
+
+        if (offset_size == sizeof(uint32_t))
+                ((uint32_t *)offsets)[h->size] = end;
+        else
+                ((uint64_t *)offsets)[h->size] = end;
+
+        if (h->prefixes != NULL)
+                h->prefixes[h->size] = classless_strvec_prefix_of_(src, len);
+
+        h->size++;
+        return true;
+}
+
+static inline size_t
+classless_strvec_append_delimited_(void *offsets, size_t offset_size,
+    const void *src, size_t len, char delim)
+{
+        const char *base = src;
+        size_t consumed = 0;
+
+        while (consumed < len) {
+                const char *end;
+                size_t record;
+
+                end = memchr(base + consumed, delim, len - consumed);
+                if (end == NULL)
+                        break;
+
+                record = end - (base + consumed);
+                if (!classless_strvec_append_(offsets, offset_size,
+                        base + consumed, record))
+                        break;
+
+                consumed += record + 1;
+        }
+
+        return consumed;
+}
+
+static inline int
+classless_strvec_compare_(const void *offsets, size_t offset_size, size_t i, size_t j)
+{
+        const struct classless_strvec_header *h;
+        const char *bytes;
+        size_t begin_i, end_i, len_i;
+        size_t begin_j, end_j, len_j;
+        int ret;
+
+        h = CLS_HEADER_OF(classless_strvec_header, offsets);
+        assert(i < h->size && j < h->size);
+
+        if (h->prefixes != NULL && h->prefixes[i] != h->prefixes[j])
+                return (h->prefixes[i] < h->prefixes[j]) ? -1 : 1;
+
+        begin_i = classless_strvec_offset_(offsets, offset_size, i);
+        end_i = classless_strvec_offset_(offsets, offset_size, i + 1);
+        begin_j = classless_strvec_offset_(offsets, offset_size, j);
+        end_j = classless_strvec_offset_(offsets, offset_size, j + 1);
+        len_i = end_i - begin_i;
+        len_j = end_j - begin_j;
+
+        bytes = cls_vec_data(h->bytes);
+        ret = memcmp(bytes + begin_i, bytes + begin_j, (len_i < len_j) ? len_i : len_j);
+        if (ret != 0)
+                return ret;
+
+        return (len_i > len_j) - (len_i < len_j);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * Without address spaces, tags are erased: tagged pointers are plain
+ * pointers, and tag checks only check for const.  This loses the
+ * detection of type confusion, but generates the same code as with
+ * tags.
+ */
+#define CLS_TAG(N)
+
+#define CLS_IS_TAG(N, P) 1
+
+#define CLS_IS_MUTABLE_TAG(N, P) (!CLS_TAG_IS_CONST(N, P))
+
+#define CLS_TAG_CHECK(N, P, ...) _Static_assert(1, "")
+
+#define CLS_MUTABLE_TAG_CHECK(N, P, ...)                                \
+        _Static_assert(CLS_IS_MUTABLE_TAG(N, P),                        \
+                       "Expected mutable pointer. " __VA_ARGS__)
+
+/*
+ * Strips all cv from the pointer type of P.
+ */
+#define CLS_TAG_STRIP_ALL(N, P) __typeof__((CLS_TAG_POINTEE(P) *)0)
+
+#define CLS_TAG_STRIPPED_ALL(N, P) ((CLS_TAG_STRIP_ALL(N, P))(uintptr_t)(P))
+
+#define CLS_TAG_CONST_STRIP(N, P) __typeof__((CLS_TAG_POINTEE(P) const *)0)
+
+#define CLS_TAG_CONST_STRIPPED(N, P) ((CLS_TAG_CONST_STRIP(N, P))(uintptr_t)(P))
+
+/*
+ * Strips volatile from the pointer type of P.
+ */
+#define CLS_TAG_STRIP(N, P) __typeof__(CLS_TAG_STRIP_(N, P))
+
+#define CLS_TAG_STRIPPED(N, P) ((CLS_TAG_STRIP(N, P))(uintptr_t)(P))
+
+#define CLS_TAG_STRIP_(N, P)                                            \
+        __builtin_choose_expr(CLS_TAG_IS_CONST(N, P),                   \
+                              (const CLS_TAG_POINTEE(P) *)0,            \
+                              (CLS_TAG_POINTEE(P) *)0)
+
+/*
+ * The statement expression evalutes to an rvalue, so we lose all
+ * qualifications on the value.  This gives us the type of the
+ * pointee, without any of the noise.
+ */
+#define CLS_TAG_POINTEE(P) __typeof__(({* (P); }))
+
+#define CLS_TAG_IS_CONST(N, P)                                          \
+        __builtin_types_compatible_p(const volatile void *,             \
+                                     __typeof__(0 ? P : (volatile void *)1))
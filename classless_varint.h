@@ -0,0 +1,428 @@
+#pragma once
+/*
+ * Variable-length integer coding between typed bufs and byte bufs.
+ *
+ * The varint coding is the usual LEB128: 7 bits per byte, least
+ * significant group first, with the high bit set on all but the last
+ * byte.  Signed values are zigzag-coded first, so that small negative
+ * values are also short.
+ *
+ * The group varint coding packs 32-bit values in groups of 4: a tag
+ * byte holds each value's byte length minus 1 in 2 bits (first value
+ * in the low bits), followed by the values' bytes, little endian.
+ * Its decoder only looks at the tag to find all 4 values, and, with
+ * SSSE3, decodes a whole group with a single byte shuffle.  Encoders
+ * pad the last group with zeros: decode into a buf with exactly as
+ * much room as there are values to drop the padding.
+ *
+ * Encoders check for space once per batch of values that fit in the
+ * destination at worst-case length, and decoders once per call, then
+ * commit everything at the end.
+ *
+ * All four functions accept unsigned and signed (zigzag) integers of
+ * 8, 16, 32 (and, for LEB128, 64) bits.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSSE3__)
+# include <tmmintrin.h>
+#endif
+
+#include "classless.h"
+#include "classless_buf.h"
+
+/*
+ * Appends the LEB128 (varint) encoding of the integers in `SRC` to the
+ * byte buf `DST`, until either is exhausted.
+ *
+ * Returns the number of values encoded.
+ */
+#define cls_varint_encode(DST, SRC)                                     \
+        CLS_VARINT_ENCODE_((DST), (SRC), classless_varint_encode_, 8)
+
+/*
+ * Appends the group varint encoding of the integers in `SRC` to the
+ * byte buf `DST`, until either is exhausted.  Groups are only written
+ * when `DST` has room for their worst-case length (1 + 4 * sizeof(T)).
+ *
+ * Returns the number of values encoded; that's all of them, or a
+ * multiple of 4.
+ */
+#define cls_group_varint_encode(DST, SRC)                               \
+        CLS_VARINT_ENCODE_((DST), (SRC), classless_group_varint_encode_, 4)
+
+/*
+ * Decodes LEB128 (varint) values from the const byte view `SRC` and
+ * appends them to the typed buf `DST`, until either is exhausted, or
+ * until a truncated value, or one that's out of range for `DST`'s
+ * element type.
+ *
+ * Returns the number of bytes consumed.
+ */
+#define cls_varint_decode(DST, SRC)                                     \
+        CLS_VARINT_DECODE_((DST), (SRC), classless_varint_decode_, 8)
+
+/*
+ * Decodes groups of 4 group varint values from the const byte view
+ * `SRC` and appends them to the typed buf `DST`, until either is
+ * exhausted, or until a truncated group, or one with a value that's
+ * out of range for `DST`'s element type.  When `DST` has room for
+ * fewer than 4 more values, the extra values in the last group are
+ * dropped.
+ *
+ * Returns the number of bytes consumed.
+ */
+#define cls_group_varint_decode(DST, SRC)                               \
+        CLS_VARINT_DECODE_((DST), (SRC), classless_group_varint_decode_, 4)
+
+#define CLS_VARINT_CHECK_(T, MAX_WIDTH)                                 \
+        _Static_assert((__typeof__(T))1 / 2 == 0                        \
+                       && sizeof(T) <= (MAX_WIDTH)                      \
+                       && (sizeof(T) & (sizeof(T) - 1)) == 0,           \
+                       "Expected an integer type of at most " #MAX_WIDTH " bytes.")
+
+#define CLS_VARINT_SIGNED_(T) ((__typeof__(T))-1 < (__typeof__(T))1)
+
+#define CLS_VARINT_ENCODE_(DST, SRC, FN, MAX_WIDTH)                     \
+        ({                                                              \
+                CLS_LET(cls_varint_dst_, DST);                          \
+                CLS_LET(cls_varint_src_, SRC);                          \
+                CLS_MUTABLE_TAG_CHECK(classless_buf, cls_varint_dst_);  \
+                CLS_TAG_CHECK(classless_buf, cls_varint_src_);          \
+                _Static_assert(sizeof(**cls_varint_dst_) == 1,          \
+                               "Varints are encoded to byte bufs.");    \
+                CLS_VARINT_CHECK_(**cls_varint_src_, MAX_WIDTH);        \
+                size_t cls_varint_written_;                             \
+                size_t cls_varint_ret_;                                 \
+                                                                        \
+                cls_varint_ret_ = FN(                                   \
+                        (uint8_t *)cls_buf_reserve(cls_varint_dst_, 0), \
+                        cls_buf_capacity(cls_varint_dst_) - cls_buf_size(cls_varint_dst_), \
+                        cls_buf_data(cls_varint_src_),                  \
+                        cls_buf_size(cls_varint_src_),                  \
+                        sizeof(**cls_varint_src_),                      \
+                        CLS_VARINT_SIGNED_(**cls_varint_src_),          \
+                        &cls_varint_written_);                          \
+                cls_buf_commit(cls_varint_dst_, cls_varint_written_);   \
+                cls_varint_ret_;                                        \
+        })
+
+#define CLS_VARINT_DECODE_(DST, SRC, FN, MAX_WIDTH)                     \
+        ({                                                              \
+                CLS_LET(cls_varint_dst_, DST);                          \
+                CLS_LET(cls_varint_src_, SRC);                          \
+                CLS_MUTABLE_TAG_CHECK(classless_buf, cls_varint_dst_);  \
+                CLS_TAG_CHECK(classless_buf, cls_varint_src_);          \
+                _Static_assert(sizeof(**cls_varint_src_) == 1,          \
+                               "Varints are decoded from byte bufs.");  \
+                CLS_VARINT_CHECK_(**cls_varint_dst_, MAX_WIDTH);        \
+                size_t cls_varint_decoded_;                             \
+                size_t cls_varint_ret_;                                 \
+                                                                        \
+                cls_varint_ret_ = FN(                                   \
+                        cls_buf_reserve(cls_varint_dst_, 0),            \
+                        cls_buf_capacity(cls_varint_dst_) - cls_buf_size(cls_varint_dst_), \
+                        (const uint8_t *)cls_buf_data(cls_varint_src_), \
+                        cls_buf_size(cls_varint_src_),                  \
+                        sizeof(**cls_varint_dst_),                      \
+                        CLS_VARINT_SIGNED_(**cls_varint_dst_),          \
+                        &cls_varint_decoded_);                          \
+                cls_buf_commit(cls_varint_dst_, cls_varint_decoded_);   \
+                cls_varint_ret_;                                        \
+        })
+
+/*
+ * Loads src[i] as a `width`-byte integer, and zigzag-codes it if
+ * `is_signed`.
+ */
+static inline uint64_t
+classless_varint_load_(const void *src, size_t i, size_t width, bool is_signed)
+{
+        uint64_t bits = 0;
+        uint64_t sign;
+
+        switch (width) {
+        case 1: bits = ((const uint8_t *)src)[i]; break;
+        case 2: bits = ((const uint16_t *)src)[i]; break;
+        case 4: bits = ((const uint32_t *)src)[i]; break;
+        default: bits = ((const uint64_t *)src)[i]; break;
+        }
+
+        if (!is_signed)
+                return bits;
+
+        /* Sign-extend to 64 bits, then zigzag in the original width. */
+        sign = -((bits >> (8 * width - 1)) & 1);
+        bits = (bits << 1) ^ sign;
+        return (width == 8) ? bits : bits & ((UINT64_C(1) << (8 * width)) - 1);
+}
+
+/*
+ * Stores the `width`-byte integer x (zigzag-coded if `is_signed`) to
+ * dst[i].
+ */
+static inline void
+classless_varint_store_(void *dst, size_t i, uint64_t x, size_t width, bool is_signed)
+{
+
+        if (is_signed)
+                x = (x >> 1) ^ -(x & 1);
+
+        switch (width) {
+        case 1: ((uint8_t *)dst)[i] = x; break;
+        case 2: ((uint16_t *)dst)[i] = x; break;
+        case 4: ((uint32_t *)dst)[i] = x; break;
+        default: ((uint64_t *)dst)[i] = x; break;
+        }
+
+        return;
+}
+
+static inline size_t
+classless_varint_length_(uint64_t x)
+{
+
+        return (x == 0) ? 1 : (70 - __builtin_clzll(x)) / 7;
+}
+
+static inline size_t
+classless_varint_put_(uint8_t *dst, uint64_t x)
+{
+        size_t i = 0;
+
+        while (x >= 0x80) {
+                dst[i++] = (uint8_t)x | 0x80;
+                x >>= 7;
+        }
+
+        dst[i++] = x;
+        return i;
+}
+
+static inline size_t
+classless_varint_encode_(uint8_t *dst, size_t room, const void *src, size_t n,
+    size_t width, bool is_signed, size_t *written)
+{
+        size_t max_length = (8 * width + 6) / 7;
+        size_t pos = 0;
+        size_t i = 0;
+
+        while (i < n) {
+                size_t batch = (room - pos) / max_length;
+
+                if (batch == 0) {
+                        /* Close to the end: check each value exactly. */
+                        uint64_t x = classless_varint_load_(src, i, width, is_signed);
+
+                        if (classless_varint_length_(x) > room - pos)
+                                break;
+
+                        pos += classless_varint_put_(&dst[pos], x);
+                        i++;
+                        continue;
+                }
+
+                if (batch > n - i)
+                        batch = n - i;
+
+                for (size_t end = i + batch; i < end; i++)
+                        pos += classless_varint_put_(&dst[pos],
+                            classless_varint_load_(src, i, width, is_signed));
+        }
+
+        *written = pos;
+        return i;
+}
+
+static inline size_t
+classless_varint_decode_(void *dst, size_t room, const uint8_t *src, size_t n,
+    size_t width, bool is_signed, size_t *decoded)
+{
+        size_t pos = 0;
+        size_t i = 0;
+
+        while (i < room && pos < n) {
+                uint64_t x = 0;
+                size_t end;
+
+                /* Runs of single-byte values are common: do 8 at a time. */
+                if (room - i >= 8 && n - pos >= 8) {
+                        uint64_t bytes;
+
+                        memcpy(&bytes, &src[pos], sizeof(bytes));
+                        if ((bytes & UINT64_C(0x8080808080808080)) == 0) {
+                                for (size_t j = 0; j < 8; j++)
+                                        classless_varint_store_(dst, i + j, src[pos + j],
+                                            width, is_signed);
+                                i += 8;
+                                pos += 8;
+                                continue;
+                        }
+                }
+
+                for (end = pos; end < n && end - pos < 10; end++) {
+                        x |= (uint64_t)(src[end] & 0x7f) << (7 * (end - pos));
+                        if ((src[end] & 0x80) == 0)
+                                break;
+                }
+
+                /* Truncated, overlong, or out of range. */
+                if (end == n || end - pos == 10 ||
+                    (end - pos == 9 && src[end] > 1) ||
+                    (width < 8 && (x >> (8 * width)) != 0))
+                        break;
+
+                classless_varint_store_(dst, i++, x, width, is_signed);
+                pos = end + 1;
+        }
+
+        *decoded = i;
+        return pos;
+}
+
+static inline size_t
+classless_group_varint_encode_(uint8_t *dst, size_t room, const void *src, size_t n,
+    size_t width, bool is_signed, size_t *written)
+{
+        size_t max_length = 1 + 4 * width;
+        size_t pos = 0;
+        size_t i = 0;
+
+        while (i < n) {
+                size_t batch = (room - pos) / max_length;
+
+                if (batch == 0)
+                        break;
+
+                for (; batch > 0 && i < n; batch--, i += 4) {
+                        size_t tag_pos = pos++;
+                        uint8_t tag = 0;
+
+                        for (size_t j = 0; j < 4; j++) {
+                                uint32_t x = 0;
+                                size_t length;
+
+                                if (i + j < n)
+                                        x = classless_varint_load_(src, i + j, width, is_signed);
+
+                                length = (x == 0) ? 1 : 4 - __builtin_clz(x) / 8;
+                                tag |= (length - 1) << (2 * j);
+                                for (size_t k = 0; k < length; k++)
+                                        dst[pos++] = x >> (8 * k);
+                        }
+
+                        dst[tag_pos] = tag;
+                }
+        }
+
+        /* Tail groups may be counted past n. */
+        *written = pos;
+        return (i < n) ? i : n;
+}
+
+#if defined(__SSSE3__)
+/*
+ * Byte shuffles from a group's payload to 4 32-bit values, for each
+ * tag byte.  0x80 zeroes the destination byte.
+ */
+#define CLS_GV_LEN_(T, I) ((((T) >> (2 * (I))) & 3) + 1)
+#define CLS_GV_OFF0_(T) 0
+#define CLS_GV_OFF1_(T) CLS_GV_LEN_(T, 0)
+#define CLS_GV_OFF2_(T) (CLS_GV_OFF1_(T) + CLS_GV_LEN_(T, 1))
+#define CLS_GV_OFF3_(T) (CLS_GV_OFF2_(T) + CLS_GV_LEN_(T, 2))
+#define CLS_GV_BYTE_(T, I, J)                                           \
+        (((J) < CLS_GV_LEN_(T, I)) ? CLS_GV_OFF##I##_(T) + (J) : 0x80)
+#define CLS_GV_LANE_(T, I)                                              \
+        CLS_GV_BYTE_(T, I, 0), CLS_GV_BYTE_(T, I, 1),                   \
+        CLS_GV_BYTE_(T, I, 2), CLS_GV_BYTE_(T, I, 3)
+#define CLS_GV_ROW_(T)                                                  \
+        { CLS_GV_LANE_(T, 0), CLS_GV_LANE_(T, 1),                       \
+          CLS_GV_LANE_(T, 2), CLS_GV_LANE_(T, 3) }
+#define CLS_GV_ROWS4_(T)                                                \
+        CLS_GV_ROW_(T), CLS_GV_ROW_(T + 1), CLS_GV_ROW_(T + 2), CLS_GV_ROW_(T + 3)
+#define CLS_GV_ROWS16_(T)                                               \
+        CLS_GV_ROWS4_(T), CLS_GV_ROWS4_(T + 4),                         \
+        CLS_GV_ROWS4_(T + 8), CLS_GV_ROWS4_(T + 12)
+#define CLS_GV_ROWS64_(T)                                               \
+        CLS_GV_ROWS16_(T), CLS_GV_ROWS16_(T + 16),                      \
+        CLS_GV_ROWS16_(T + 32), CLS_GV_ROWS16_(T + 48)
+
+static const uint8_t classless_group_varint_shuffle_[256][16]
+__attribute__((__aligned__(16), __unused__)) = {
+        CLS_GV_ROWS64_(0), CLS_GV_ROWS64_(64),
+        CLS_GV_ROWS64_(128), CLS_GV_ROWS64_(192),
+};
+#endif
+
+static inline size_t
+classless_group_varint_decode_(void *dst, size_t room, const uint8_t *src, size_t n,
+    size_t width, bool is_signed, size_t *decoded)
+{
+        size_t pos = 0;
+        size_t i = 0;
+
+        while (i < room && pos < n) {
+                uint8_t tag = src[pos];
+                size_t length = 4 + (tag & 3) + ((tag >> 2) & 3)
+                        + ((tag >> 4) & 3) + (tag >> 6);
+                uint32_t values[4] = { 0 };
+                uint32_t all = 0;
+                size_t count;
+                size_t offset;
+
+                if (1 + length > n - pos)
+                        break;
+
+#if defined(__SSSE3__)
+                /* The shuffle loads 16 payload bytes, and stores 4 values. */
+                if (width == 4 && room - i >= 4 && n - pos >= 1 + 16) {
+                        __m128i payload = _mm_loadu_si128((const void *)&src[pos + 1]);
+                        __m128i shuffle = _mm_load_si128(
+                                (const void *)classless_group_varint_shuffle_[tag]);
+                        __m128i v = _mm_shuffle_epi8(payload, shuffle);
+
+                        if (is_signed) {
+                                __m128i sign = _mm_sub_epi32(_mm_setzero_si128(),
+                                    _mm_and_si128(v, _mm_set1_epi32(1)));
+
+                                v = _mm_xor_si128(_mm_srli_epi32(v, 1), sign);
+                        }
+
+                        _mm_storeu_si128((void *)&((uint32_t *)dst)[i], v);
+                        i += 4;
+                        pos += 1 + length;
+                        continue;
+                }
+#endif
+
+                offset = pos + 1;
+                for (size_t j = 0; j < 4; j++) {
+                        size_t value_length = ((tag >> (2 * j)) & 3) + 1;
+
+                        for (size_t k = 0; k < value_length; k++)
+                                values[j] |= (uint32_t)src[offset + k] << (8 * k);
+                        offset += value_length;
+                }
+
+                count = (room - i < 4) ? room - i : 4;
+                for (size_t j = 0; j < count; j++)
+                        all |= values[j];
+
+                /* Out of range: leave the whole group in `SRC`. */
+                if (width < 4 && (all >> (8 * width)) != 0)
+                        break;
+
+                for (size_t j = 0; j < count; j++)
+                        classless_varint_store_(dst, i + j, values[j], width, is_signed);
+
+                i += count;
+                pos += 1 + length;
+        }
+
+        *decoded = i;
+        return pos;
+}
@@ -31,6 +31,27 @@ CLS_TAG_REGISTER(classless_vec, 101);
  */
 #define cls_vec CLS_TAG(classless_vec)
 
+/*
+ * A shared vec is a reference-counted vec, `T cls_shared_vec *`.  The
+ * reference count lives in a larger header, in front of the usual vec
+ * header, so all vec operations except `cls_vec_destroy` also accept
+ * shared vecs.  Shared references are `const T cls_shared_vec *`, so
+ * the mutating operations only accept a shared vec once
+ * `cls_vec_make_mutable` has unshared it.
+ *
+ * The pointer to the data array is tagged with address space 106.
+ */
+CLS_TAG_REGISTER(classless_shared_vec, 106);
+
+#define cls_shared_vec CLS_TAG(classless_shared_vec)
+
+struct classless_shared_vec_header {
+        size_t refcount;
+        /* Keep the data 16-byte aligned, like malloc. */
+        size_t padding;
+        struct classless_vec_header vec;
+};
+
 /*
  * Allocates a vec of T with the specified capacity, or returns NULL
  * on allocation failure.
@@ -51,8 +72,73 @@ CLS_TAG_REGISTER(classless_vec, 101);
                 classless_vec_destroy_(CLS_TAG_STRIPPED(classless_vec, cls_vec_)); \
         })
 
+/*
+ * Allocates a shared vec of T with the specified capacity, and a
+ * reference count of 1, or returns NULL on allocation failure.
+ *
+ * The data is not zero-filled.
+ */
+#define cls_vec_create_shared(T, CAPACITY)                              \
+        ((__typeof__(T) cls_shared_vec *) classless_shared_vec_create_((CAPACITY), sizeof(T)))
+
+/*
+ * Acquires a new reference to a shared vec, and returns it as a
+ * `const T cls_shared_vec *`.  Safe to call on NULL.
+ *
+ * The vec is now shared: stop mutating it through `VEC`, and get a
+ * mutable reference back with `cls_vec_make_mutable`.
+ */
+#define cls_vec_share(VEC)                                              \
+        ({                                                              \
+                CLS_LET(cls_vec_, (VEC));                               \
+                CLS_TAG_CHECK(classless_shared_vec, cls_vec_);          \
+                                                                        \
+                if (cls_vec_ != NULL)                                   \
+                        __atomic_add_fetch(                             \
+                                &CLS_HEADER_OF(classless_shared_vec_header, cls_vec_)->refcount, \
+                                1, __ATOMIC_RELAXED);                   \
+                (const CLS_TAG_POINTEE(cls_vec_) cls_shared_vec *)cls_vec_; \
+        })
+
+/*
+ * Releases a reference to a shared vec, and deallocates it when that
+ * was the last one.  Safe to call on NULL.
+ */
+#define cls_vec_release(VEC)                                            \
+        ({                                                              \
+                CLS_LET(cls_vec_, (VEC));                               \
+                CLS_TAG_CHECK(classless_shared_vec, cls_vec_);          \
+                                                                        \
+                classless_shared_vec_release_(                          \
+                        (void *)(uintptr_t)cls_vec_);                   \
+        })
+
+/*
+ * Returns a mutable `T cls_shared_vec *` with the same contents (and
+ * capacity) as the (possibly const) shared vec `VEC` that isn't shared
+ * with anyone else: `VEC` itself if the caller holds the only
+ * reference, otherwise a copy, in which case the caller's reference to
+ * `VEC` is released.
+ *
+ * Returns NULL on allocation failure, and then `VEC` is unchanged.
+ * Safe to call on NULL.
+ */
+#define cls_vec_make_mutable(VEC)                                       \
+        ({                                                              \
+                CLS_LET(cls_vec_, (VEC));                               \
+                CLS_TAG_CHECK(classless_shared_vec, cls_vec_);          \
+                                                                        \
+                (CLS_TAG_POINTEE(cls_vec_) cls_shared_vec *)classless_shared_vec_make_mutable_( \
+                        (void *)(uintptr_t)cls_vec_,                    \
+                        sizeof(*CLS_VEC_STRIPPED_(cls_vec_)));          \
+        })
+
 /*
  * Converts a vec to a view of its data starting at OFFSET.
+ *
+ * Like `cls_buf_view`, the result of this and the other vec to buf
+ * conversions must be used directly as a function argument; their
+ * arguments are evaluated more than once.
  */
 #define cls_vec_view(VEC, OFFSET) cls_buf_view(CLS_VEC_VIEW_((VEC), (OFFSET)))
 
@@ -62,22 +148,17 @@ CLS_TAG_REGISTER(classless_vec, 101);
 #define cls_vec_const_view(VEC, OFFSET)                         \
         cls_buf_const_view(CLS_VEC_VIEW_((VEC), (OFFSET)))
 
+/*
+ * The blocks must be compound literals in the caller's scope: one in
+ * a statement expression would not outlive the expression.
+ */
 #define CLS_VEC_VIEW_(VEC, OFFSET)                                      \
-        ({                                                              \
-                CLS_LET(cls_vec_, VEC);                                 \
-                size_t cls_vec_offset_ = OFFSET;                        \
-                CLS_TAG_CHECK(classless_vec, cls_vec_);                 \
-                CLS_LET_HEADER(classless_vec_header, cls_vec_h_, cls_vec_); \
-                                                                        \
-                if (cls_vec_offset_ > cls_vec_h_->size)                 \
-                        cls_vec_offset_ = cls_vec_h_->size;             \
-                                                                        \
-                cls_buf_block(                                          \
-                        &CLS_TAG_STRIPPED(classless_vec, cls_vec_)[cls_vec_offset_], \
-                        NULL,                                           \
-                        cls_vec_h_->size - cls_vec_offset_,             \
-                        cls_vec_h_->capacity - cls_vec_offset_);        \
-        })
+        cls_buf_block(&CLS_VEC_STRIPPED_((VEC))[CLS_VEC_OFFSET_((VEC), (OFFSET))], \
+                      NULL,                                             \
+                      CLS_HEADER_OF(classless_vec_header, (VEC))->size  \
+                      - CLS_VEC_OFFSET_((VEC), (OFFSET)),               \
+                      CLS_HEADER_OF(classless_vec_header, (VEC))->capacity \
+                      - CLS_VEC_OFFSET_((VEC), (OFFSET)))
 
 /*
  * Converts a mutable vec to a buf of its data starting at OFFSET, and with
@@ -94,45 +175,35 @@ CLS_TAG_REGISTER(classless_vec, 101);
         cls_buf_ref(CLS_VEC_BUF_TAIL_((VEC), (TAIL)))
 
 #define CLS_VEC_BUF_(VEC, OFFSET, TAIL)                                 \
-        ({                                                              \
-                CLS_LET(cls_vec_, VEC);                                 \
-                size_t cls_vec_offset_ = OFFSET;                        \
-                size_t cls_vec_tail_ = TAIL;                            \
-                size_t cls_vec_remaining_;                              \
-                CLS_MUTABLE_TAG_CHECK(classless_vec, cls_vec_);         \
-                CLS_LET_HEADER(classless_vec_header, cls_vec_h_, cls_vec_); \
-                                                                        \
-                if (cls_vec_offset_ > cls_vec_h_->size)                   \
-                        cls_vec_offset_ = cls_vec_h_->size;             \
-                if (cls_vec_tail_ >= cls_vec_h_->capacity - cls_vec_h_->size) \
-                        cls_vec_tail_ = cls_vec_h_->capacity - cls_vec_h_->size; \
-                                                                        \
-                cls_vec_remaining_ = cls_vec_h_->size - cls_vec_offset_; \
-                cls_buf_block(                                          \
-                        &CLS_TAG_STRIPPED(classless_vec, cls_vec_)[     \
-                                cls_vec_offset_],                       \
-                        &cls_vec_h_->size,                              \
-                        cls_vec_remaining_,                             \
-                        cls_vec_remaining_ + cls_vec_tail_);            \
-        })
+        cls_buf_block(&CLS_VEC_STRIPPED_(CLS_VEC_MUTABLE_CHECKED_(VEC))[ \
+                              CLS_VEC_OFFSET_((VEC), (OFFSET))],        \
+                      &CLS_HEADER_OF(classless_vec_header, (VEC))->size, \
+                      CLS_HEADER_OF(classless_vec_header, (VEC))->size  \
+                      - CLS_VEC_OFFSET_((VEC), (OFFSET)),               \
+                      CLS_HEADER_OF(classless_vec_header, (VEC))->size  \
+                      - CLS_VEC_OFFSET_((VEC), (OFFSET))                \
+                      + CLS_VEC_TAIL_((VEC), (TAIL)))
 
 #define CLS_VEC_BUF_TAIL_(VEC, TAIL)                                    \
-        ({                                                              \
-                CLS_LET(cls_vec_, VEC);                                 \
-                size_t cls_vec_tail_ = TAIL;                            \
-                CLS_MUTABLE_TAG_CHECK(classless_vec, cls_vec_);         \
-                CLS_LET_HEADER(classless_vec_header, cls_vec_h_, cls_vec_); \
-                                                                        \
-                if (cls_vec_tail_ >= cls_vec_h_->capacity - cls_vec_h_->size) \
-                        cls_vec_tail_ = cls_vec_h_->capacity - cls_vec_h_->size; \
-                                                                        \
-                cls_buf_block(                                          \
-                        &CLS_TAG_STRIPPED(classless_vec, cls_vec_)[     \
-                                cls_vec_h_->size],                      \
-                        &cls_vec_h_->size,                              \
-                        0,                                              \
-                        cls_vec_tail_);                                 \
-        })
+        cls_buf_block(&CLS_VEC_STRIPPED_(CLS_VEC_MUTABLE_CHECKED_(VEC))[ \
+                              CLS_HEADER_OF(classless_vec_header, (VEC))->size], \
+                      &CLS_HEADER_OF(classless_vec_header, (VEC))->size, \
+                      0,                                                \
+                      CLS_VEC_TAIL_((VEC), (TAIL)))
+
+/*
+ * OFFSET, clamped to the vec's size.
+ */
+#define CLS_VEC_OFFSET_(VEC, OFFSET)                                    \
+        classless_vec_clamp_((OFFSET), CLS_HEADER_OF(classless_vec_header, (VEC))->size)
+
+/*
+ * TAIL, clamped to the vec's remaining capacity.
+ */
+#define CLS_VEC_TAIL_(VEC, TAIL)                                        \
+        classless_vec_clamp_((TAIL),                                    \
+                             CLS_HEADER_OF(classless_vec_header, (VEC))->capacity \
+                             - CLS_HEADER_OF(classless_vec_header, (VEC))->size)
 
 /*
  * Returns a reference to the i'th value in the vec.
@@ -145,12 +216,12 @@ CLS_TAG_REGISTER(classless_vec, 101);
         ({                                                              \
                 CLS_LET(cls_vec_, VEC);                                 \
                 size_t cls_vec_i_ = I;                                 \
-                CLS_TAG_CHECK(classless_vec, cls_vec_);                 \
+                CLS_VEC_TAG_CHECK_(cls_vec_);                           \
                 CLS_LET_HEADER(classless_vec_header, cls_vec_h_, cls_vec_); \
                                                                         \
                 assert(cls_vec_i_ < cls_vec_h_->size);                  \
                 (cls_vec_i_ < cls_vec_h_->size)                         \
-                        ? &CLS_TAG_STRIPPED(classless_vec, cls_vec_)[cls_vec_i_] \
+                        ? &CLS_VEC_STRIPPED_(cls_vec_)[cls_vec_i_]      \
                         : NULL;                                         \
         })                                                              \
 
@@ -160,9 +231,9 @@ CLS_TAG_REGISTER(classless_vec, 101);
 #define cls_vec_data(VEC)                                               \
         ({                                                              \
                 CLS_LET(cls_vec_, (VEC));                               \
-                CLS_TAG_CHECK(classless_vec, cls_vec_);                 \
+                CLS_VEC_TAG_CHECK_(cls_vec_);                           \
                                                                         \
-                CLS_TAG_STRIPPED(classless_vec, cls_vec_);              \
+                CLS_VEC_STRIPPED_(cls_vec_);                            \
         })
 
 /*
@@ -173,10 +244,10 @@ CLS_TAG_REGISTER(classless_vec, 101);
 #define cls_vec_push(VEC, X)                                            \
         ({                                                              \
                 CLS_LET(cls_vec_, (VEC));                               \
-                __typeof__(*CLS_TAG_STRIPPED(classless_vec, cls_vec_))  \
+                __typeof__(*CLS_VEC_STRIPPED_(cls_vec_))                \
                         cls_vec_x_ = (X);                               \
-                CLS_MUTABLE_TAG_CHECK(classless_vec, cls_vec_);         \
-                CLS_LET_STRIPPED(classless_vec, cls_vec_ptr_, cls_vec_); \
+                CLS_VEC_MUTABLE_TAG_CHECK_(cls_vec_);                   \
+                CLS_VEC_LET_STRIPPED_(cls_vec_ptr_, cls_vec_);          \
                 CLS_LET_HEADER(classless_vec_header, cls_vec_h_, cls_vec_); \
                                                                         \
                 (cls_vec_h_->size < cls_vec_h_->capacity)               \
@@ -193,8 +264,8 @@ CLS_TAG_REGISTER(classless_vec, 101);
 #define cls_vec_bump(VEC)                                               \
         ({                                                              \
                 CLS_LET(cls_vec_, (VEC));                               \
-                CLS_MUTABLE_TAG_CHECK(classless_vec, cls_vec_);         \
-                CLS_LET_STRIPPED(classless_vec, cls_vec_ptr_, cls_vec_); \
+                CLS_VEC_MUTABLE_TAG_CHECK_(cls_vec_);                   \
+                CLS_VEC_LET_STRIPPED_(cls_vec_ptr_, cls_vec_);          \
                 CLS_LET_HEADER(classless_vec_header, cls_vec_h_, cls_vec_); \
                                                                         \
                 (cls_vec_h_->size < cls_vec_h_->capacity)               \
@@ -212,8 +283,8 @@ CLS_TAG_REGISTER(classless_vec, 101);
         ({                                                              \
                 CLS_LET(cls_vec_, (VEC));                               \
                 size_t cls_vec_n_ = (N);                                \
-                CLS_MUTABLE_TAG_CHECK(classless_vec, cls_vec_);         \
-                CLS_LET_STRIPPED(classless_vec, cls_vec_ptr_, cls_vec_); \
+                CLS_VEC_MUTABLE_TAG_CHECK_(cls_vec_);                   \
+                CLS_VEC_LET_STRIPPED_(cls_vec_ptr_, cls_vec_);          \
                 CLS_LET_HEADER(classless_vec_header, cls_vec_h_, cls_vec_); \
                                                                         \
                 (cls_vec_n_ <= cls_vec_h_->capacity - cls_vec_h_->size) \
@@ -231,7 +302,7 @@ CLS_TAG_REGISTER(classless_vec, 101);
         ({                                                              \
                 CLS_LET(cls_vec_, (VEC));                               \
                 size_t cls_vec_n_ = (N);                                \
-                CLS_MUTABLE_TAG_CHECK(classless_vec, cls_vec_);         \
+                CLS_VEC_MUTABLE_TAG_CHECK_(cls_vec_);                   \
                 CLS_LET_HEADER(classless_vec_header, cls_vec_h_, cls_vec_); \
                                                                         \
                 (cls_vec_n_ <= cls_vec_h_->capacity)                    \
@@ -241,7 +312,7 @@ CLS_TAG_REGISTER(classless_vec, 101);
 #define cls_vec_size(VEC)                                               \
         ({                                                              \
                 CLS_LET(cls_vec_, (VEC));                               \
-                CLS_TAG_CHECK(classless_vec, cls_vec_);                 \
+                CLS_VEC_TAG_CHECK_(cls_vec_);                           \
                                                                         \
                 (cls_vec_ == NULL)                                      \
                 ? 0                                                     \
@@ -252,7 +323,7 @@ CLS_TAG_REGISTER(classless_vec, 101);
         ({                                                              \
                 CLS_LET(cls_vec_, (VEC));                               \
                 size_t cls_vec_size_ = (SIZE);                          \
-                CLS_MUTABLE_TAG_CHECK(classless_vec, cls_vec_);         \
+                CLS_VEC_MUTABLE_TAG_CHECK_(cls_vec_);                   \
                 CLS_LET_HEADER(classless_vec_header, cls_vec_h_, cls_vec_); \
                                                                         \
                 (cls_vec_size_ <= cls_vec_h_->capacity)                 \
@@ -262,20 +333,64 @@ CLS_TAG_REGISTER(classless_vec, 101);
 #define cls_vec_capacity(VEC)                                           \
         ({                                                              \
                 CLS_LET(cls_vec_, (VEC));                               \
-                CLS_TAG_CHECK(classless_vec, cls_vec_);                 \
+                CLS_VEC_TAG_CHECK_(cls_vec_);                           \
                                                                         \
                 (cls_vec_ == NULL)                                      \
                 ? 0                                                     \
                 : CLS_HEADER_OF(classless_vec_header, cls_vec_)->capacity;  \
         })
 
+/*
+ * Vec operations accept both (unshared) vecs and shared vecs.
+ */
+#define CLS_VEC_TAG_CHECK_(P)                                           \
+        _Static_assert(CLS_IS_TAG(classless_vec, P)                     \
+                       || CLS_IS_TAG(classless_shared_vec, P),          \
+                       "Expected tagged (classless_vec or classless_shared_vec) " \
+                       "non-volatile pointer.")
+
+#define CLS_VEC_MUTABLE_TAG_CHECK_(P)                                   \
+        _Static_assert(CLS_IS_MUTABLE_TAG(classless_vec, P)             \
+                       || CLS_IS_MUTABLE_TAG(classless_shared_vec, P),  \
+                       "Expected mutable tagged (classless_vec or "     \
+                       "classless_shared_vec) non-volatile pointer.")
+
+#define CLS_VEC_STRIPPED_(P)                                            \
+        __builtin_choose_expr(CLS_IS_TAG(classless_vec, P),             \
+                              CLS_TAG_STRIPPED(classless_vec, P),       \
+                              CLS_TAG_STRIPPED(classless_shared_vec, P))
+
+/*
+ * Evaluates to P if it's a mutable (plain or shared) vec, and fails
+ * to compile otherwise.
+ */
+#define CLS_VEC_MUTABLE_CHECKED_(P)                                     \
+        __builtin_choose_expr(CLS_IS_MUTABLE_TAG(classless_vec, (P))    \
+                              || CLS_IS_MUTABLE_TAG(classless_shared_vec, (P)), \
+                              (P), (void)0)
+
+#define CLS_VEC_LET_STRIPPED_(V, P)                                     \
+        __typeof__(CLS_VEC_STRIPPED_(P)) V = (void *)(uintptr_t)(P)
+
+static inline size_t
+classless_vec_clamp_(size_t x, size_t max)
+{
+
+        return (x < max) ? x : max;
+}
+
 static inline void *
 classless_vec_create_(size_t capacity, size_t elsize)
 {
         struct classless_vec_header *h;
 
-        /* XXX: overflow. */
+        if (elsize != 0 && capacity > (SIZE_MAX - sizeof(*h)) / elsize)
+                return NULL;
+
         h = malloc(sizeof(*h) + capacity * elsize);
+        if (h == NULL)
+                return NULL;
+
         h->size = 0;
         h->capacity = capacity;
         return h + 1;
@@ -293,3 +408,61 @@ classless_vec_destroy_(void *data)
         free(h);
         return;
 }
+
+static inline void *
+classless_shared_vec_create_(size_t capacity, size_t elsize)
+{
+        struct classless_shared_vec_header *h;
+
+        if (elsize != 0 && capacity > (SIZE_MAX - sizeof(*h)) / elsize)
+                return NULL;
+
+        h = malloc(sizeof(*h) + capacity * elsize);
+        if (h == NULL)
+                return NULL;
+
+        h->refcount = 1;
+        h->padding = 0;
+        h->vec.size = 0;
+        h->vec.capacity = capacity;
+        return h + 1;
+}
+
+static inline void
+classless_shared_vec_release_(void *data)
+{
+        struct classless_shared_vec_header *h;
+
+        if (data == NULL)
+                return;
+
+        h = (void *)((uintptr_t)data - sizeof(*h));
+        if (__atomic_sub_fetch(&h->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+                free(h);
+
+        return;
+}
+
+static inline void *
+classless_shared_vec_make_mutable_(void *data, size_t elsize)
+{
+        struct classless_shared_vec_header *h;
+        void *copy;
+
+        if (data == NULL)
+                return NULL;
+
+        h = (void *)((uintptr_t)data - sizeof(*h));
+        /* Pairs with the release in classless_shared_vec_release_. */
+        if (__atomic_load_n(&h->refcount, __ATOMIC_ACQUIRE) == 1)
+                return data;
+
+        copy = classless_shared_vec_create_(h->vec.capacity, elsize);
+        if (copy == NULL)
+                return NULL;
+
+        memcpy(copy, data, h->vec.size * elsize);
+        ((struct classless_vec_header *)copy)[-1].size = h->vec.size;
+        classless_shared_vec_release_(data);
+        return copy;
+}
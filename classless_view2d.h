@@ -0,0 +1,424 @@
+#pragma once
+/*
+ * A view2d is a strided 2D view: `ROWS` rows of `COLS` elements each,
+ * with consecutive rows `STRIDE` elements apart.  Rows, columns and
+ * rectangular sub-blocks of a view2d are also views, without any copy.
+ *
+ * Like a buf, a view2d is represented as an array of pointers, of
+ * which three are actually integers (the stride, the number of
+ * columns, and the number of rows), followed by the data pointer and a
+ * dummy NULL; the view2d is passed around as a pointer to that NULL.
+ * The same lifetime rules apply: views built by the macros here must
+ * be used directly as function arguments.  To that end, the macros
+ * that build views expand to a compound literal in the caller's scope
+ * (rather than in a statement expression), so they evaluate their
+ * arguments more than once.
+ *
+ * Walking a large row-major matrix along its columns touches a new
+ * cache line (and, eventually, a new page) for every element.  The
+ * tiled iteration and the transpose below instead work on blocks that
+ * fit in the L1 cache.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "classless.h"
+#include "classless_buf.h"
+#include "classless_vec.h"
+
+/*
+ * Tiles span about that many bytes.  The default leaves room for a
+ * source and a destination tile in a 32 KB L1 data cache.
+ */
+#ifndef CLS_VIEW2D_TILE_BYTES
+# define CLS_VIEW2D_TILE_BYTES 16384
+#endif
+
+typedef uint16_t classless_view2d_u16_t __attribute__((__may_alias__));
+typedef uint32_t classless_view2d_u32_t __attribute__((__may_alias__));
+typedef uint64_t classless_view2d_u64_t __attribute__((__may_alias__));
+
+/*
+ * The pointer to array of pointers is tagged with address space 107.
+ */
+CLS_TAG_REGISTER(classless_view2d, 107);
+
+enum {
+        CLS_VIEW2D_IDX_STRIDE = -4,
+        CLS_VIEW2D_IDX_COLS = -3,
+        CLS_VIEW2D_IDX_ROWS = -2,
+        CLS_VIEW2D_IDX_DATA = -1,
+};
+
+/*
+ * A read-only 2D view is `const T cls_view2d const *`.
+ * A read-write 2D view is `T cls_view2d const *`.
+ */
+#define cls_view2d * CLS_TAG(classless_view2d)
+
+/*
+ * Creates backing storage for a view2d of ROWS x COLS elements, with
+ * the first element at DATA, and consecutive rows STRIDE elements
+ * apart.
+ */
+#define cls_view2d_block(DATA, ROWS, COLS, STRIDE)                      \
+        ((__typeof__(__typeof(*(DATA)) *)[]) {                          \
+                (void *)(uintptr_t)(STRIDE),                            \
+                (void *)(uintptr_t)(COLS),                              \
+                (void *)(uintptr_t)(ROWS),                              \
+                &(DATA)[0],                                             \
+                (void *)0,                                              \
+        })
+
+/*
+ * Converts a block to a view2d argument.
+ */
+#define cls_view2d_view(BLOCK)                                          \
+        ((__typeof__((BLOCK)[4][0]) * const CLS_TAG(classless_view2d) *) \
+         (uintptr_t)(&(BLOCK)[4]))
+
+/*
+ * Converts a block to a const view2d argument.
+ */
+#define cls_view2d_const_view(BLOCK)                                    \
+        ((const __typeof__((BLOCK)[4][0]) *const CLS_TAG(classless_view2d) *) \
+         (uintptr_t)(&(BLOCK)[4]))
+
+/*
+ * Converts a vec to a view2d of rows of COLS elements.  A trailing
+ * partial row is not part of the view.
+ */
+#define cls_vec_view2d(VEC, COLS) cls_view2d_view(CLS_VEC_VIEW2D_((VEC), (COLS)))
+
+/*
+ * Converts a vec to a const view2d of rows of COLS elements.
+ */
+#define cls_vec_const_view2d(VEC, COLS)                                 \
+        cls_view2d_const_view(CLS_VEC_VIEW2D_((VEC), (COLS)))
+
+#define CLS_VEC_VIEW2D_(VEC, COLS)                                      \
+        cls_view2d_block(CLS_VEC_STRIPPED_(VEC),                        \
+                         classless_view2d_rows_of_(                     \
+                                 CLS_HEADER_OF(classless_vec_header, (VEC))->size, \
+                                 (COLS)),                               \
+                         (COLS), (COLS))
+
+/*
+ * Returns a pointer to the view2d's first element.
+ */
+#define cls_view2d_data(VIEW)                                           \
+        ({                                                              \
+                CLS_LET(cls_view2d_, (VIEW));                           \
+                CLS_TAG_CHECK(classless_view2d, cls_view2d_);           \
+                                                                        \
+                cls_view2d_[CLS_VIEW2D_IDX_DATA];                       \
+        })
+
+#define cls_view2d_rows(VIEW)                                           \
+        ({                                                              \
+                CLS_LET(cls_view2d_, (VIEW));                           \
+                CLS_TAG_CHECK(classless_view2d, cls_view2d_);           \
+                                                                        \
+                (size_t)(uintptr_t)cls_view2d_[CLS_VIEW2D_IDX_ROWS];    \
+        })
+
+#define cls_view2d_cols(VIEW)                                           \
+        ({                                                              \
+                CLS_LET(cls_view2d_, (VIEW));                           \
+                CLS_TAG_CHECK(classless_view2d, cls_view2d_);           \
+                                                                        \
+                (size_t)(uintptr_t)cls_view2d_[CLS_VIEW2D_IDX_COLS];    \
+        })
+
+/*
+ * Returns the distance between consecutive rows, in elements.
+ */
+#define cls_view2d_stride(VIEW)                                         \
+        ({                                                              \
+                CLS_LET(cls_view2d_, (VIEW));                           \
+                CLS_TAG_CHECK(classless_view2d, cls_view2d_);           \
+                                                                        \
+                (size_t)(uintptr_t)cls_view2d_[CLS_VIEW2D_IDX_STRIDE];  \
+        })
+
+/*
+ * Returns a reference to the element at row I and column J.
+ *
+ * Performs bound checking when asserts are enabled.
+ */
+#define cls_view2d_at(VIEW, I, J) (*CLS_VIEW2D_AT_((VIEW), (I), (J)))
+
+#define CLS_VIEW2D_AT_(VIEW, I, J)                                      \
+        ({                                                              \
+                CLS_LET(cls_view2d_, (VIEW));                           \
+                CLS_TAG_CHECK(classless_view2d, cls_view2d_);           \
+                size_t cls_view2d_i_ = (I);                             \
+                size_t cls_view2d_j_ = (J);                             \
+                size_t cls_view2d_rows_ = (uintptr_t)cls_view2d_[CLS_VIEW2D_IDX_ROWS]; \
+                size_t cls_view2d_cols_ = (uintptr_t)cls_view2d_[CLS_VIEW2D_IDX_COLS]; \
+                size_t cls_view2d_stride_ = (uintptr_t)cls_view2d_[CLS_VIEW2D_IDX_STRIDE]; \
+                                                                        \
+                assert(cls_view2d_i_ < cls_view2d_rows_ && cls_view2d_j_ < cls_view2d_cols_); \
+                (cls_view2d_i_ < cls_view2d_rows_ && cls_view2d_j_ < cls_view2d_cols_) \
+                        ? CLS_NONNULL(&cls_view2d_[CLS_VIEW2D_IDX_DATA][ \
+                                cls_view2d_i_ * cls_view2d_stride_ + cls_view2d_j_]) \
+                        : NULL;                                         \
+        })
+
+/*
+ * Converts row I of the view2d to a (contiguous) buf view; the view is
+ * empty if I is out of range.
+ */
+#define cls_view2d_row(VIEW, I) cls_buf_view(CLS_VIEW2D_ROW_((VIEW), (I)))
+
+#define CLS_VIEW2D_ROW_(VIEW, I)                                        \
+        cls_buf_block(&CLS_VIEW2D_CHECKED_(VIEW)[CLS_VIEW2D_IDX_DATA][  \
+                              classless_view2d_offset_(CLS_VIEW2D_DIMS_(VIEW), \
+                                                       (I), 0, 1, SIZE_MAX)], \
+                      NULL,                                             \
+                      classless_view2d_extent_(CLS_VIEW2D_DIMS_(VIEW),  \
+                                               (I), 0, 1, SIZE_MAX, false), \
+                      classless_view2d_extent_(CLS_VIEW2D_DIMS_(VIEW),  \
+                                               (I), 0, 1, SIZE_MAX, false))
+
+/*
+ * Converts column J of the view2d to a view2d with a single column.
+ */
+#define cls_view2d_col(VIEW, J)                                         \
+        cls_view2d_view(CLS_VIEW2D_SUB_((VIEW), 0, (J), SIZE_MAX, 1))
+
+/*
+ * Converts the sub-block of (up to) ROWS x COLS elements starting at
+ * row I and column J to a view2d.  The sub-block is clipped to the
+ * view2d's bounds.
+ */
+#define cls_view2d_sub(VIEW, I, J, ROWS, COLS)                          \
+        cls_view2d_view(CLS_VIEW2D_SUB_((VIEW), (I), (J), (ROWS), (COLS)))
+
+#define CLS_VIEW2D_SUB_(VIEW, I, J, ROWS, COLS)                         \
+        cls_view2d_block(&CLS_VIEW2D_CHECKED_(VIEW)[CLS_VIEW2D_IDX_DATA][ \
+                                 classless_view2d_offset_(CLS_VIEW2D_DIMS_(VIEW), \
+                                                          (I), (J), (ROWS), (COLS))], \
+                         classless_view2d_extent_(CLS_VIEW2D_DIMS_(VIEW), \
+                                                  (I), (J), (ROWS), (COLS), true), \
+                         classless_view2d_extent_(CLS_VIEW2D_DIMS_(VIEW), \
+                                                  (I), (J), (ROWS), (COLS), false), \
+                         (uintptr_t)(VIEW)[CLS_VIEW2D_IDX_STRIDE])
+
+/*
+ * Evaluates to VIEW if it's a view2d, and fails to compile otherwise.
+ */
+#define CLS_VIEW2D_CHECKED_(VIEW)                                       \
+        __builtin_choose_expr(CLS_IS_TAG(classless_view2d, (VIEW)), (VIEW), (void)0)
+
+/*
+ * Expands to the rows, columns and stride of VIEW.
+ */
+#define CLS_VIEW2D_DIMS_(VIEW)                                          \
+        (size_t)(uintptr_t)CLS_VIEW2D_CHECKED_(VIEW)[CLS_VIEW2D_IDX_ROWS], \
+        (size_t)(uintptr_t)(VIEW)[CLS_VIEW2D_IDX_COLS],                 \
+        (size_t)(uintptr_t)(VIEW)[CLS_VIEW2D_IDX_STRIDE]
+
+/*
+ * Iterates over the view2d in square tiles of about
+ * CLS_VIEW2D_TILE_BYTES, in row-major tile order.  For each tile, the
+ * loop body sees the tile's first row and column in the `size_t`
+ * variables named I and J, and its dimensions in ROWS and COLS; e.g.,
+ *
+ *     cls_view2d_foreach_tile(view, i, j, rows, cols)
+ *             process(cls_view2d_sub(view, i, j, rows, cols));
+ *
+ * VIEW is evaluated more than once.
+ */
+#define cls_view2d_foreach_tile(VIEW, I, J, ROWS, COLS)                 \
+        for (size_t cls_tile_side_ = classless_view2d_tile_side_(sizeof(**(VIEW))), \
+                 cls_tile_rows_ = cls_view2d_rows(VIEW),                \
+                 cls_tile_cols_ = cls_view2d_cols(VIEW),                \
+                 cls_tile_across_ = (cls_tile_cols_ + cls_tile_side_ - 1) / cls_tile_side_, \
+                 cls_tile_n_ = (cls_tile_rows_ + cls_tile_side_ - 1) / cls_tile_side_ \
+                         * cls_tile_across_,                            \
+                 cls_tile_t_ = 0, I = 0, J = 0, ROWS = 0, COLS = 0;     \
+             cls_tile_t_ < cls_tile_n_                                  \
+                     && (I = cls_tile_t_ / cls_tile_across_ * cls_tile_side_, \
+                         J = cls_tile_t_ % cls_tile_across_ * cls_tile_side_, \
+                         ROWS = (cls_tile_rows_ - I < cls_tile_side_)   \
+                                 ? cls_tile_rows_ - I : cls_tile_side_, \
+                         COLS = (cls_tile_cols_ - J < cls_tile_side_)   \
+                                 ? cls_tile_cols_ - J : cls_tile_side_, \
+                         true);                                         \
+             cls_tile_t_++)
+
+/*
+ * Attempts to append the transpose of the view2d `SRC` to the mutable
+ * vec `DST`, i.e., to append column j of `SRC` as the j'th row of
+ * `cls_view2d_rows(SRC)` elements.
+ *
+ * Returns true on success, does nothing and returns false if `DST`
+ * doesn't have enough room.
+ *
+ * The transpose recursively splits the larger dimension in half, so
+ * it's cache-efficient for any cache size, without tuning.
+ */
+#define cls_view2d_transpose(DST, SRC)                                  \
+        ({                                                              \
+                CLS_LET(cls_view2d_dst_, (DST));                        \
+                CLS_LET(cls_view2d_src_, (SRC));                        \
+                CLS_VEC_MUTABLE_TAG_CHECK_(cls_view2d_dst_);            \
+                CLS_TAG_CHECK(classless_view2d, cls_view2d_src_);       \
+                _Static_assert(sizeof(*CLS_VEC_STRIPPED_(cls_view2d_dst_)) \
+                               == sizeof(**cls_view2d_src_),            \
+                               "Transpose source and destination must have the same element size."); \
+                size_t cls_view2d_rows_ = (uintptr_t)cls_view2d_src_[CLS_VIEW2D_IDX_ROWS]; \
+                size_t cls_view2d_cols_ = (uintptr_t)cls_view2d_src_[CLS_VIEW2D_IDX_COLS]; \
+                size_t cls_view2d_n_ = cls_view2d_rows_ * cls_view2d_cols_; \
+                void *cls_view2d_out_ = cls_vec_reserve(cls_view2d_dst_, cls_view2d_n_); \
+                                                                        \
+                if (cls_view2d_out_ != NULL)                            \
+                        classless_view2d_transpose_(                    \
+                                cls_view2d_out_, cls_view2d_rows_,      \
+                                (const void *)cls_view2d_src_[CLS_VIEW2D_IDX_DATA], \
+                                (uintptr_t)cls_view2d_src_[CLS_VIEW2D_IDX_STRIDE], \
+                                cls_view2d_rows_, cls_view2d_cols_,     \
+                                sizeof(**cls_view2d_src_));             \
+                                                                        \
+                cls_view2d_out_ != NULL                                 \
+                        && cls_vec_commit(cls_view2d_dst_, cls_view2d_n_); \
+        })
+
+static inline size_t
+classless_view2d_rows_of_(size_t size, size_t cols)
+{
+
+        return (cols == 0) ? 0 : size / cols;
+}
+
+static inline size_t
+classless_view2d_min_(size_t x, size_t y)
+{
+
+        return (x < y) ? x : y;
+}
+
+/*
+ * Returns the number of rows (if `want_rows`) or columns of the
+ * sub-block of up to `sub_rows` x `sub_cols` elements at row `i` and
+ * column `j`, clipped to the `rows` x `cols` view2d.  Both are 0 if the
+ * clipped sub-block is empty.
+ */
+static inline size_t
+classless_view2d_extent_(size_t rows, size_t cols, size_t stride,
+    size_t i, size_t j, size_t sub_rows, size_t sub_cols, bool want_rows)
+{
+        size_t clipped_rows, clipped_cols;
+
+        (void)stride;
+        i = classless_view2d_min_(i, rows);
+        j = classless_view2d_min_(j, cols);
+        clipped_rows = classless_view2d_min_(sub_rows, rows - i);
+        clipped_cols = classless_view2d_min_(sub_cols, cols - j);
+        if (clipped_rows == 0 || clipped_cols == 0)
+                return 0;
+
+        return want_rows ? clipped_rows : clipped_cols;
+}
+
+/*
+ * Returns the offset of the first element of the same sub-block, or 0
+ * if it's empty, so that we never point past the data.
+ */
+static inline size_t
+classless_view2d_offset_(size_t rows, size_t cols, size_t stride,
+    size_t i, size_t j, size_t sub_rows, size_t sub_cols)
+{
+
+        if (classless_view2d_extent_(rows, cols, stride, i, j,
+                sub_rows, sub_cols, true) == 0)
+                return 0;
+
+        return i * stride + j;
+}
+
+/*
+ * Returns the side of the largest power-of-two square tile of `elsize`
+ * byte elements that fits in CLS_VIEW2D_TILE_BYTES.
+ */
+static inline size_t
+classless_view2d_tile_side_(size_t elsize)
+{
+        size_t side = 1;
+
+        while (4 * side * side * elsize <= CLS_VIEW2D_TILE_BYTES)
+                side *= 2;
+
+        return side;
+}
+
+#define CLS_VIEW2D_TRANSPOSE_BASE_(T)                                   \
+        do {                                                            \
+                T *out = dst;                                           \
+                const T *in = src;                                      \
+                                                                        \
+                for (size_t i = 0; i < rows; i++) {                     \
+                        for (size_t j = 0; j < cols; j++)               \
+                                out[j * dst_stride + i] = in[i * src_stride + j]; \
+                }                                                       \
+        } while (0)
+
+/*
+ * Writes the transpose of the `rows` x `cols` matrix at `src` (with
+ * row stride `src_stride`) to `dst` (with row stride `dst_stride`).
+ */
+static inline void
+classless_view2d_transpose_(void *dst, size_t dst_stride, const void *src,
+    size_t src_stride, size_t rows, size_t cols, size_t elsize)
+{
+
+        while (rows > 16 || cols > 16) {
+                if (rows >= cols) {
+                        size_t half = rows / 2;
+
+                        classless_view2d_transpose_(dst, dst_stride, src, src_stride,
+                            half, cols, elsize);
+                        dst = (char *)dst + half * elsize;
+                        src = (const char *)src + half * src_stride * elsize;
+                        rows -= half;
+                } else {
+                        size_t half = cols / 2;
+
+                        classless_view2d_transpose_(dst, dst_stride, src, src_stride,
+                            rows, half, elsize);
+                        dst = (char *)dst + half * dst_stride * elsize;
+                        src = (const char *)src + half * elsize;
+                        cols -= half;
+                }
+        }
+
+        switch (elsize) {
+        case 1:
+                CLS_VIEW2D_TRANSPOSE_BASE_(uint8_t);
+                break;
+        case 2:
+                CLS_VIEW2D_TRANSPOSE_BASE_(classless_view2d_u16_t);
+                break;
+        case 4:
+                CLS_VIEW2D_TRANSPOSE_BASE_(classless_view2d_u32_t);
+                break;
+        case 8:
+                CLS_VIEW2D_TRANSPOSE_BASE_(classless_view2d_u64_t);
+                break;
+        default:
+                for (size_t i = 0; i < rows; i++) {
+                        for (size_t j = 0; j < cols; j++)
+                                memcpy((char *)dst + (j * dst_stride + i) * elsize,
+                                    (const char *)src + (i * src_stride + j) * elsize,
+                                    elsize);
+                }
+                break;
+        }
+
+        return;
+}
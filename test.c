@@ -1,6 +1,18 @@
 #include "classless.h"
 
+#include "classless_arena.h"
 #include "classless_buf.h"
+#include "classless_deque.h"
+#include "classless_filter.h"
+#include "classless_flushbuf.h"
+#include "classless_gather.h"
+#include "classless_heap.h"
+#include "classless_packedvec.h"
+#include "classless_rcu.h"
+#include "classless_reduce.h"
+#include "classless_strvec.h"
+#include "classless_varint.h"
+#include "classless_view2d.h"
 #include "classless_vec.h"
 
 cls_vec int *
@@ -189,3 +201,652 @@ test_vec_buf_push(cls_vec int *vec)
         buf_test_push(cls_vec_buf_tail(vec, -1));
         return;
 }
+
+#define INT_LESS(A, B) ((A) < (B))
+
+bool
+heap_test_push(cls_heap int *heap)
+{
+
+        return cls_heap_push(heap, 1, INT_LESS);
+}
+
+int
+heap_test_pop(cls_heap int *heap)
+{
+        int *top;
+        int ret;
+
+        top = cls_heap_top(heap);
+        if (top == NULL)
+                return -1;
+
+        ret = *top;
+        cls_heap_pop(heap, INT_LESS);
+        return ret;
+}
+
+bool
+heap_test_replace_top(cls_heap int *heap)
+{
+
+        return cls_heap_replace_top(heap, 2, INT_LESS);
+}
+
+static bool
+heap_test_borrowed_heapify(cls_heap int *heap, const int cls_buf const *buf)
+{
+
+        return cls_heap_heapify(heap, buf, INT_LESS);
+}
+
+bool
+heap_test_heapify(cls_heap int *heap, cls_vec int *vec)
+{
+
+        return heap_test_borrowed_heapify(heap, cls_vec_const_view(vec, 0));
+}
+
+static void
+heap_test_borrowed_topk(cls_heap int *heap, const int cls_buf const *buf)
+{
+
+        cls_topk(heap, buf, INT_LESS);
+        return;
+}
+
+void
+heap_test_topk(cls_heap int *heap, cls_vec int *vec)
+{
+
+        heap_test_borrowed_topk(heap, cls_vec_const_view(vec, 0));
+        return;
+}
+
+uint32_t cls_strvec *
+strvec_test_create(void)
+{
+
+        return cls_strvec_create(uint32_t, 16, 1024, true);
+}
+
+static bool
+strvec_test_borrowed_append(uint32_t cls_strvec *strvec, const char cls_buf const *buf)
+{
+
+        return cls_strvec_append(strvec, buf);
+}
+
+bool
+strvec_test_append(uint32_t cls_strvec *strvec, cls_vec char *vec)
+{
+
+        return strvec_test_borrowed_append(strvec, cls_vec_const_view(vec, 0));
+}
+
+static size_t
+strvec_test_borrowed_append_delimited(uint64_t cls_strvec *strvec,
+    const char cls_buf const *buf)
+{
+
+        return cls_strvec_append_delimited(strvec, buf, '\n');
+}
+
+size_t
+strvec_test_append_delimited(uint64_t cls_strvec *strvec, cls_vec char *vec)
+{
+
+        return strvec_test_borrowed_append_delimited(strvec, cls_vec_const_view(vec, 0));
+}
+
+static char
+strvec_test_borrowed_first(const char cls_buf const *buf)
+{
+
+        return cls_buf_at(buf, 0);
+}
+
+char
+strvec_test_at(const uint32_t cls_strvec *strvec)
+{
+
+        return strvec_test_borrowed_first(cls_strvec_at(strvec, 1));
+}
+
+int
+strvec_test_compare(const uint32_t cls_strvec *strvec)
+{
+
+        return cls_strvec_compare(strvec, 0, 1);
+}
+
+static uint32_t cls_packedvec *
+packedvec_test_borrowed_encode(const uint32_t cls_buf const *buf)
+{
+
+        return cls_packedvec_encode(buf, true);
+}
+
+uint32_t cls_packedvec *
+packedvec_test_encode(cls_vec uint32_t *vec)
+{
+
+        return packedvec_test_borrowed_encode(cls_vec_const_view(vec, 0));
+}
+
+uint32_t
+packedvec_test_at(const uint32_t cls_packedvec *pv)
+{
+
+        return cls_packedvec_at(pv, 130);
+}
+
+static bool
+packedvec_test_borrowed_decode(const uint32_t cls_packedvec *pv, uint32_t cls_buf *buf)
+{
+
+        return cls_packedvec_decode(pv, 1, buf);
+}
+
+bool
+packedvec_test_decode(const uint32_t cls_packedvec *pv, cls_vec uint32_t *vec)
+{
+
+        return packedvec_test_borrowed_decode(pv, cls_vec_buf_tail(vec, -1));
+}
+
+static size_t
+varint_test_borrowed_encode(uint8_t cls_buf *dst, const int64_t cls_buf const *src)
+{
+
+        return cls_varint_encode(dst, src);
+}
+
+size_t
+varint_test_encode(cls_vec uint8_t *bytes, cls_vec int64_t *vec)
+{
+
+        return varint_test_borrowed_encode(cls_vec_buf_tail(bytes, -1),
+            cls_vec_const_view(vec, 0));
+}
+
+static size_t
+varint_test_borrowed_decode(uint32_t cls_buf *dst, const uint8_t cls_buf const *src)
+{
+
+        return cls_varint_decode(dst, src);
+}
+
+size_t
+varint_test_decode(cls_vec uint32_t *vec, cls_vec uint8_t *bytes)
+{
+
+        return varint_test_borrowed_decode(cls_vec_buf_tail(vec, -1),
+            cls_vec_const_view(bytes, 0));
+}
+
+static size_t
+varint_test_borrowed_decode64(uint64_t cls_buf *dst, const uint8_t cls_buf const *src)
+{
+
+        return cls_varint_decode(dst, src);
+}
+
+bool
+varint_test_decode_overflow(void)
+{
+        static const uint8_t bytes[] = {
+                0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f,
+        };
+        uint64_t values[1];
+        size_t size = 0;
+        size_t consumed;
+
+        consumed = varint_test_borrowed_decode64(
+            cls_buf_ref(cls_buf_block(values, &size, 0, 1)),
+            cls_buf_const_view(cls_buf_block(bytes, NULL, sizeof(bytes), sizeof(bytes))));
+        return consumed == 0 && size == 0;
+}
+
+static size_t
+group_varint_test_borrowed_encode(uint8_t cls_buf *dst, const uint32_t cls_buf const *src)
+{
+
+        return cls_group_varint_encode(dst, src);
+}
+
+size_t
+group_varint_test_encode(cls_vec uint8_t *bytes, cls_vec uint32_t *vec)
+{
+
+        return group_varint_test_borrowed_encode(cls_vec_buf_tail(bytes, -1),
+            cls_vec_const_view(vec, 0));
+}
+
+static size_t
+group_varint_test_borrowed_decode(int32_t cls_buf *dst, const uint8_t cls_buf const *src)
+{
+
+        return cls_group_varint_decode(dst, src);
+}
+
+size_t
+group_varint_test_decode(cls_vec int32_t *vec, cls_vec uint8_t *bytes)
+{
+
+        return group_varint_test_borrowed_decode(cls_vec_buf_tail(vec, -1),
+            cls_vec_const_view(bytes, 0));
+}
+
+static bool
+gather_test_borrowed(int cls_buf *dst, const int cls_buf const *src,
+    const uint32_t cls_buf const *idx)
+{
+
+        return cls_buf_gather(dst, src, idx);
+}
+
+bool
+gather_test(cls_vec int *dst, cls_vec int *src, cls_vec uint32_t *idx)
+{
+
+        return gather_test_borrowed(cls_vec_buf_tail(dst, -1),
+            cls_vec_const_view(src, 0), cls_vec_const_view(idx, 0));
+}
+
+static bool
+scatter_test_borrowed(double cls_buf const *dst, const size_t cls_buf const *idx,
+    const double cls_buf const *src)
+{
+
+        return cls_buf_scatter(dst, idx, src);
+}
+
+bool
+scatter_test(cls_vec double *dst, cls_vec size_t *idx, cls_vec double *src)
+{
+
+        return scatter_test_borrowed(cls_vec_view(dst, 0),
+            cls_vec_const_view(idx, 0), cls_vec_const_view(src, 0));
+}
+
+#define INT_IS_ODD(X) (((X) & 1) != 0)
+
+static size_t
+filter_test_borrowed(int cls_buf *dst, const int cls_buf const *src)
+{
+
+        return cls_buf_filter(dst, src, INT_IS_ODD);
+}
+
+size_t
+filter_test(cls_vec int *dst, cls_vec int *src)
+{
+
+        return filter_test_borrowed(cls_vec_buf_tail(dst, -1), cls_vec_const_view(src, 0));
+}
+
+static size_t
+compress_test_borrowed(int cls_buf *dst, const int cls_buf const *src,
+    const uint64_t cls_buf const *mask)
+{
+
+        return cls_buf_compress(dst, src, mask);
+}
+
+size_t
+compress_test(cls_vec int *dst, cls_vec int *src, cls_vec uint64_t *mask)
+{
+
+        return compress_test_borrowed(cls_vec_buf_tail(dst, -1),
+            cls_vec_const_view(src, 0), cls_vec_const_view(mask, 0));
+}
+
+size_t
+remove_if_test(cls_vec int *vec)
+{
+
+        return cls_vec_remove_if(vec, INT_IS_ODD);
+}
+
+size_t
+partition_test(cls_vec int *vec)
+{
+
+        return cls_vec_partition(vec, INT_IS_ODD);
+}
+
+static int64_t
+sum_test_borrowed(const int cls_buf const *view)
+{
+
+        return cls_buf_sum(view);
+}
+
+int64_t
+sum_test(cls_vec int *vec)
+{
+
+        return sum_test_borrowed(cls_vec_const_view(vec, 0));
+}
+
+static size_t
+argmin_test_borrowed(const float cls_buf const *view)
+{
+
+        return cls_buf_argmin(view);
+}
+
+size_t
+argmin_test(cls_vec float *vec)
+{
+
+        return argmin_test_borrowed(cls_vec_const_view(vec, 0));
+}
+
+static size_t
+count_eq_test_borrowed(const uint16_t cls_buf const *view, uint16_t x)
+{
+
+        return cls_buf_count_eq(view, x);
+}
+
+size_t
+count_eq_test(cls_vec uint16_t *vec, uint16_t x)
+{
+
+        return count_eq_test_borrowed(cls_vec_const_view(vec, 0), x);
+}
+
+static bool
+histogram_test_borrowed(uint64_t cls_buf const *counts, const uint8_t cls_buf const *view)
+{
+
+        return cls_buf_histogram(counts, view);
+}
+
+bool
+histogram_test(cls_vec uint64_t *counts, cls_vec uint8_t *vec)
+{
+
+        return histogram_test_borrowed(cls_vec_view(counts, 0), cls_vec_const_view(vec, 0));
+}
+
+size_t
+rcu_test_read(int cls_vec_rcu *rcu, struct classless_vec_rcu_reader *reader)
+{
+        const int cls_vec *snapshot = cls_vec_rcu_read(rcu);
+        size_t ret = cls_vec_size(snapshot);
+
+        cls_vec_rcu_quiescent(rcu, reader);
+        return ret;
+}
+
+void
+rcu_test_publish(int cls_vec_rcu *rcu, int cls_vec *vec)
+{
+
+        cls_vec_rcu_publish(rcu, vec);
+        cls_vec_rcu_synchronize(rcu);
+        return;
+}
+
+size_t
+rcu_test_reader(int cls_vec_rcu *rcu)
+{
+        struct classless_vec_rcu_reader reader;
+        size_t ret;
+
+        cls_vec_rcu_register(rcu, &reader);
+        ret = rcu_test_read(rcu, &reader);
+        ret += cls_vec_size(cls_vec_rcu_read(rcu));
+        cls_vec_rcu_unregister(rcu, &reader);
+        return ret;
+}
+
+int cls_vec_rcu *
+rcu_test_create_empty(void)
+{
+
+        return cls_vec_rcu_create(int, (int cls_vec *)NULL);
+}
+
+const int cls_shared_vec *
+shared_vec_test_fanout(const int cls_shared_vec *vec, size_t *size)
+{
+
+        *size = cls_vec_size(vec) + cls_buf_size(cls_vec_const_view(vec, 0));
+        return cls_vec_share(vec);
+}
+
+bool
+shared_vec_test_push(const int cls_shared_vec **vec, int x)
+{
+        int cls_shared_vec *unshared = cls_vec_make_mutable(*vec);
+
+        if (unshared == NULL)
+                return false;
+
+        *vec = unshared;
+        return cls_vec_push(unshared, x);
+}
+
+void
+shared_vec_test_release(const int cls_shared_vec *vec)
+{
+
+        cls_vec_release(vec);
+        return;
+}
+
+static size_t
+view2d_test_row_borrowed(const double cls_buf const *row)
+{
+
+        return cls_buf_size(row);
+}
+
+static size_t
+view2d_test_col_borrowed(const double cls_view2d const *col)
+{
+
+        return cls_view2d_rows(col);
+}
+
+static double
+view2d_test_borrowed(const double cls_view2d const *view)
+{
+        double ret = 0;
+
+        cls_view2d_foreach_tile(view, i, j, rows, cols) {
+                for (size_t r = i; r < i + rows; r++) {
+                        for (size_t c = j; c < j + cols; c++)
+                                ret += cls_view2d_at(view, r, c);
+                }
+        }
+
+        return ret + view2d_test_row_borrowed(cls_view2d_row(view, 0))
+            + view2d_test_col_borrowed(cls_view2d_col(view, 1));
+}
+
+double
+view2d_test(cls_vec double *vec, size_t cols)
+{
+
+        return view2d_test_borrowed(cls_vec_const_view2d(vec, cols));
+}
+
+static bool
+view2d_test_transpose_borrowed(cls_vec double *dst, const double cls_view2d const *view)
+{
+
+        return cls_view2d_transpose(dst, view);
+}
+
+bool
+view2d_test_transpose(cls_vec double *dst, const double cls_view2d const *view)
+{
+
+        return view2d_test_transpose_borrowed(dst, cls_view2d_sub(view, 1, 1, 8, 8));
+}
+
+bool
+flushbuf_test_push(int cls_flushbuf *fb, const int cls_buf const *src)
+{
+
+        for (size_t i = 0; i < cls_buf_size(src); i++) {
+                if (!cls_flushbuf_push(fb, cls_buf_at(src, i)))
+                        return false;
+        }
+
+        return cls_flushbuf_flush(fb);
+}
+
+bool
+flushbuf_test_reserve(uint8_t cls_flushbuf *fb, const uint8_t *src, size_t n)
+{
+        uint8_t *dst = cls_flushbuf_reserve(fb, n);
+
+        if (dst == NULL)
+                return false;
+
+        memcpy(dst, src, n);
+        return cls_flushbuf_commit(fb, n);
+}
+
+bool
+flushbuf_test_buf(int cls_flushbuf *fb, int x)
+{
+
+        return cls_buf_push(cls_flushbuf_buf(fb), x);
+}
+
+bool
+flushbuf_test_fd(int fd, const int cls_buf const *src)
+{
+        int cls_flushbuf *fb = cls_flushbuf_create_fd(int, 1024, fd, true);
+
+        if (fb == NULL)
+                return false;
+
+        return flushbuf_test_push(fb, src) & cls_flushbuf_destroy(fb);
+}
+
+static int
+deque_test_sum_borrowed(const int cls_buf const *view)
+{
+        int ret = 0;
+
+        for (size_t i = 0; i < cls_buf_size(view); i++)
+                ret += cls_buf_at(view, i);
+
+        return ret;
+}
+
+int
+deque_test_sum(int cls_deque *deque)
+{
+
+        return deque_test_sum_borrowed(cls_deque_const_view(deque, 0))
+            + deque_test_sum_borrowed(cls_deque_const_view(deque, 1));
+}
+
+int cls_deque *
+deque_test_push(int cls_deque *deque, int x)
+{
+
+        if (!cls_deque_push_back(deque, x)) {
+                int cls_deque *grown = cls_deque_grow(deque, 2 * cls_deque_capacity(deque) + 1);
+
+                if (grown == NULL)
+                        return NULL;
+
+                deque = grown;
+                cls_deque_push_back(deque, x);
+        }
+
+        return deque;
+}
+
+bool
+deque_test_pop(int cls_deque *deque, int *out)
+{
+        int *front = cls_deque_front(deque);
+
+        if (front == NULL)
+                return false;
+
+        *out = *front;
+        return cls_deque_pop_front(deque);
+}
+
+int
+deque_test_compact(int cls_deque *deque)
+{
+
+        cls_deque_compact(deque);
+        return deque_test_sum_borrowed(cls_deque_const_view(deque, 0));
+}
+
+struct intf_test_point {
+        int x;
+        int y;
+};
+
+static int
+intf_test_point_compare(const struct intf_test_point *a, const struct intf_test_point *b)
+{
+
+        return (a->x != b->x) ? (a->x > b->x) - (a->x < b->x) : (a->y > b->y) - (a->y < b->y);
+}
+
+static const struct {
+        const struct intf_test_point *element;
+        int (*compare)(const struct intf_test_point *, const struct intf_test_point *);
+#include CLS_INTF_REGISTER
+        .compare = intf_test_point_compare,
+};
+
+size_t
+intf_test_argmin(const struct intf_test_point cls_buf const *points)
+{
+        size_t ret = 0;
+
+        for (size_t i = 1; i < cls_buf_size(points); i++) {
+                if (CLS_INTF_CALL(&cls_buf_at(points, i), compare, &cls_buf_at(points, ret)) < 0)
+                        ret = i;
+        }
+
+        return ret;
+}
+
+size_t
+arena_test_request(uint8_t cls_arena *arena, const int cls_buf const *src)
+{
+        struct classless_arena_mark mark = cls_arena_mark(arena);
+        int cls_vec *odd = cls_arena_vec(arena, int, cls_buf_size(src));
+        size_t ret;
+
+        if (odd == NULL)
+                return 0;
+
+        for (size_t i = 0; i < cls_buf_size(src); i++) {
+                if (cls_buf_at(src, i) % 2 != 0)
+                        cls_vec_push(odd, cls_buf_at(src, i));
+        }
+
+        ret = cls_vec_size(odd);
+        cls_arena_rewind(arena, mark);
+        return ret;
+}
+
+bool
+arena_test_buf(uint8_t cls_arena *arena, int x)
+{
+        int cls_buf *buf = cls_arena_buf(arena, int, 16);
+        double *scratch = cls_arena_alloc(arena, double, 4);
+        bool ret = buf != NULL && scratch != NULL && cls_buf_push(buf, x);
+
+        cls_arena_reset(arena);
+        return ret;
+}